@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations by replacing the global operator new and delete.
+// The whole set of replaceable allocation functions is replaced, so that
+// every delete matches the new it frees. Replacement functions cannot be
+// inline, so include this header in exactly one source file of a program.
+
+inline std::atomic<uint64_t> num_allocations(0);
+
+// Allocations made by the program so far.
+inline uint64_t NumAllocations() {
+  return num_allocations.load(std::memory_order_relaxed);
+}
+
+inline void* CountedAlloc(size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if(void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size) {
+  return CountedAlloc(size);
+}
+
+void* operator new[](size_t size) {
+  return CountedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  std::free(p);
+}
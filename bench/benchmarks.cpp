@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "ConnectFour.h"
+#include "FlatHashMap.h"
+#include "MinimaxAgent.h"
+#include "MonteCarloTreeSearchAgent.h"
+#include "Random.h"
+#include "Stopwatch.h"
+#include "TemporalDifferenceAgent.h"
+#include "TicTacToe.h"
+
+// Micro- and macro-benchmarks of the games and agents. Every benchmark is
+// run for some warm-up repetitions and then for the measured ones; a
+// repetition calls the benchmark body until at least --min-time ms have
+// passed and yields one rate in operations per second. The median and
+// spread of the rates, and heap allocations per operation, are printed and
+// optionally written as JSON for comparison between builds.
+//
+// usage: benchmarks [--filter text] [--warmup n] [--repetitions n]
+//                   [--min-time ms] [--json path]
+//
+// All benchmarks are single-threaded and seeded, so a run on the same
+// machine repeats the same work.
+
+volatile uint64_t sink;
+
+struct Options {
+  std::string filter;
+  int warmup = 1;
+  int repetitions = 5;
+  double min_time_ms = 100;
+  std::string json_path;
+};
+
+struct BenchmarkResult {
+  std::string name;
+  std::string unit;
+  std::vector<double> rates;  // operations per second, one per repetition
+  double allocations_per_op = 0;
+
+  double Median() const {
+    std::vector<double> sorted = rates;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+  }
+
+  double Mean() const {
+    double sum = 0;
+    for(double rate : rates) {
+      sum += rate;
+    }
+    return sum / rates.size();
+  }
+
+  double StdDev() const {
+    double mean = Mean(), sum = 0;
+    for(double rate : rates) {
+      sum += (rate - mean) * (rate - mean);
+    }
+    return rates.size() > 1 ? std::sqrt(sum / (rates.size() - 1)) : 0;
+  }
+
+  double Min() const {
+    return *std::min_element(rates.begin(), rates.end());
+  }
+
+  double Max() const {
+    return *std::max_element(rates.begin(), rates.end());
+  }
+};
+
+// A benchmark body does a batch of work and returns how many operations,
+// in the benchmark's unit, it performed.
+struct Benchmark {
+  std::string name;
+  std::string unit;
+  std::function<uint64_t()> body;
+};
+
+BenchmarkResult Run(Benchmark const& benchmark, Options const& options) {
+  BenchmarkResult result;
+  result.name = benchmark.name;
+  result.unit = benchmark.unit;
+  uint64_t total_ops = 0, total_allocations = 0;
+  for(int repetition = -options.warmup; repetition < options.repetitions; repetition++) {
+    uint64_t ops = 0;
+    uint64_t allocations = NumAllocations();
+    Stopwatch sw;
+    sw.Start();
+    do {
+      ops += benchmark.body();
+    } while(sw.ElapsedMillis() < options.min_time_ms);
+    sw.Stop();
+    allocations = NumAllocations() - allocations;
+    if(repetition >= 0) {
+      result.rates.push_back(ops / sw.ElapsedMillis() * 1000);
+      total_ops += ops;
+      total_allocations += allocations;
+    }
+  }
+  result.allocations_per_op = total_ops ? double(total_allocations) / total_ops : 0;
+  return result;
+}
+
+// Positions and move sequences of random games, generated once so that
+// every repetition replays the same work.
+template <class Game>
+struct RandomGames {
+  std::vector<std::vector<typename Game::Action>> moves;
+  std::vector<Game> positions;  // every non-terminal position of the games
+  uint64_t num_moves = 0;
+
+  RandomGames(size_t num_games, Xoshiro256& rng) {
+    moves.resize(num_games);
+    for(auto& game_moves : moves) {
+      Game game;
+      while(!game.GameOver()) {
+        positions.push_back(game);
+        auto actions = game.GetAvailableActions();
+        auto action = *select_randomly(actions.begin(), actions.end(), rng);
+        game_moves.push_back(action);
+        game.ApplyAction(action);
+        num_moves++;
+      }
+    }
+  }
+};
+
+struct GameSettings {
+  size_t mcts_iterations;
+  int minimax_depth;
+  int td_games;
+};
+
+template <class Game>
+void AddGameBenchmarks(std::vector<Benchmark>& benchmarks, std::string const& game_name,
+                       GameSettings const& settings) {
+  Xoshiro256 setup_rng(1);
+  auto games = std::make_shared<RandomGames<Game>>(1000, setup_rng);
+
+  // Replays the stored games; every move includes the status update.
+  benchmarks.push_back({game_name + "/apply_action", "moves", [games]() {
+    uint64_t checksum = 0;
+    for(auto const& game_moves : games->moves) {
+      Game game;
+      for(auto const& action : game_moves) {
+        game.ApplyAction(action);
+      }
+      checksum += uint64_t(game.GetGameStatus());
+    }
+    sink = checksum;
+    return games->num_moves;
+  }});
+
+  benchmarks.push_back({game_name + "/available_actions", "calls", [games]() {
+    uint64_t checksum = 0;
+    for(Game const& position : games->positions) {
+      checksum += position.GetAvailableActions().size();
+    }
+    sink = checksum;
+    return uint64_t(games->positions.size());
+  }});
+
+  auto rollout_rng = std::make_shared<Xoshiro256>(2);
+  benchmarks.push_back({game_name + "/random_rollout", "moves", [rollout_rng]() {
+    uint64_t moves = 0;
+    for(int i = 0; i < 100; i++) {
+      Game game;
+      while(!game.GameOver()) {
+        auto actions = game.GetAvailableActions();
+        game.ApplyAction(*select_randomly(actions.begin(), actions.end(), *rollout_rng));
+        moves++;
+      }
+    }
+    return moves;
+  }});
+
+  auto mcts = std::make_shared<MonteCarloTreeSearchAgent<Game>>();
+  mcts->SetIterationLimit(settings.mcts_iterations);
+  mcts->SetTreeReuse(false);
+  mcts->SetSeed(3);
+  benchmarks.push_back({game_name + "/mcts", "iterations", [mcts, settings]() {
+    Game game;
+    mcts->GetAction(game);
+    return uint64_t(settings.mcts_iterations);
+  }});
+
+  // A fresh agent per search, so that transposition table hits from earlier
+  // searches do not shrink the tree.
+  benchmarks.push_back({game_name + "/minimax_alpha_beta", "nodes", [settings]() {
+    MinimaxAgent<Game> agent;
+    agent.SetAlphaBeta(true);
+    agent.SetTranspositionTableSize(1 << 16);
+    agent.SetDepthLimit(settings.minimax_depth);
+    Game game;
+    agent.GetAction(game);
+    return agent.NodesSearched();
+  }});
+
+  // Self-play with exploration; every move is one table update. Every call
+  // starts from empty tables and reseeds the thread generator the agent
+  // explores with, so that each call repeats the same games.
+  benchmarks.push_back({game_name + "/td_update", "updates", [settings]() {
+    SeedThreadRng(5);
+    FlatHashMap<uint64_t, float> values, terminal_values;
+    TemporalDifferenceAgent<Game> agent(&values, &terminal_values);
+    agent.SetExplorationRate(0.1);
+    uint64_t updates = 0;
+    for(int i = 0; i < settings.td_games; i++) {
+      Game game;
+      while(!game.GameOver()) {
+        agent.TakeAction(game);
+        updates++;
+      }
+    }
+    return updates;
+  }});
+}
+
+void AddConnectFourBatchBenchmarks(std::vector<Benchmark>& benchmarks) {
+  auto rng = std::make_shared<Xoshiro256>(4);
+  auto batch = std::make_shared<ConnectFourBatch>(1024);
+  benchmarks.push_back({"connect_four/batch_rollout", "moves", [rng, batch]() {
+    batch->Assign(ConnectFour(), 1024);
+    batch->RandomPlayouts(*rng);
+    uint64_t moves = 0;
+    for(size_t i = 0; i < batch->size(); i++) {
+      moves += batch->NumMoves(i);
+    }
+    return moves;
+  }});
+}
+
+void WriteJson(FILE* out, std::vector<BenchmarkResult> const& results, Options const& options) {
+  char date[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+  std::fprintf(out, "{\n  \"context\": {\n");
+  std::fprintf(out, "    \"date\": \"%s\",\n", date);
+  std::fprintf(out, "    \"compiler\": \"%s\",\n", __VERSION__);
+  std::fprintf(out, "    \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+  std::fprintf(out, "    \"warmup\": %d,\n", options.warmup);
+  std::fprintf(out, "    \"repetitions\": %d,\n", options.repetitions);
+  std::fprintf(out, "    \"min_time_ms\": %g\n", options.min_time_ms);
+  std::fprintf(out, "  },\n  \"benchmarks\": [");
+  for(size_t i = 0; i < results.size(); i++) {
+    BenchmarkResult const& result = results[i];
+    std::fprintf(out, "%s\n    {\"name\": \"%s\", \"unit\": \"%s\", ", i ? "," : "",
+                 result.name.c_str(), result.unit.c_str());
+    std::fprintf(out, "\"median\": %.6g, \"mean\": %.6g, \"stddev\": %.6g, \"min\": %.6g, \"max\": %.6g, ",
+                 result.Median(), result.Mean(), result.StdDev(), result.Min(), result.Max());
+    std::fprintf(out, "\"allocations_per_op\": %.6g, \"rates\": [", result.allocations_per_op);
+    for(size_t j = 0; j < result.rates.size(); j++) {
+      std::fprintf(out, "%s%.6g", j ? ", " : "", result.rates[j]);
+    }
+    std::fprintf(out, "]}");
+  }
+  std::fprintf(out, "\n  ]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  for(int i = 1; i + 1 < argc; i += 2) {
+    std::string flag = argv[i];
+    if(flag == "--filter") {
+      options.filter = argv[i + 1];
+    } else if(flag == "--warmup") {
+      options.warmup = std::max(0, std::atoi(argv[i + 1]));
+    } else if(flag == "--repetitions") {
+      options.repetitions = std::max(1, std::atoi(argv[i + 1]));
+    } else if(flag == "--min-time") {
+      options.min_time_ms = std::atof(argv[i + 1]);
+    } else if(flag == "--json") {
+      options.json_path = argv[i + 1];
+    } else {
+      std::cerr << "unknown option " << flag << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Benchmark> benchmarks;
+  AddGameBenchmarks<TicTacToe>(benchmarks, "tictactoe", {2000, 9, 100});
+  AddGameBenchmarks<ConnectFour>(benchmarks, "connect_four", {2000, 8, 20});
+  AddConnectFourBatchBenchmarks(benchmarks);
+
+  std::vector<BenchmarkResult> results;
+  std::printf("%-32s %-10s %14s %9s %12s\n", "benchmark", "unit", "median/s", "stddev%", "allocs/op");
+  for(Benchmark const& benchmark : benchmarks) {
+    if(benchmark.name.find(options.filter) == std::string::npos) {
+      continue;
+    }
+    results.push_back(Run(benchmark, options));
+    BenchmarkResult const& result = results.back();
+    std::printf("%-32s %-10s %14.4g %9.2f %12.3g\n", result.name.c_str(), result.unit.c_str(),
+                result.Median(), 100 * result.StdDev() / result.Mean(), result.allocations_per_op);
+    std::fflush(stdout);
+  }
+
+  if(!options.json_path.empty()) {
+    FILE* out = options.json_path == "-" ? stdout : std::fopen(options.json_path.c_str(), "w");
+    if(!out) {
+      std::cerr << "could not write " << options.json_path << std::endl;
+      return 1;
+    }
+    WriteJson(out, results, options);
+    if(out != stdout) {
+      std::fclose(out);
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "ConnectFour.h"
+#include "utils.h"
+#include "Random.h"
+#include "Stopwatch.h"
+
+// Random playout throughput on ConnectFour from the empty board: the
+// generic playout loop over ConnectFour, and ConnectFourBatch at several
+// batch sizes (below eight boards it uses its scalar loop). Every row plays
+// the same number of games.
+//
+// usage: connect_four_playouts [games]   (default 2^20)
+volatile int sink;
+
+int main(int argc, char* argv[]) {
+  size_t games = argc > 1 ? std::atoll(argv[1]) : 1 << 20;
+  ConnectFour start;
+  Xoshiro256 rng(1);
+
+  std::cout << "engine\tbatch\tms\tmoves_per_second" << std::endl;
+
+  Stopwatch sw;
+  size_t moves = 0;
+  int score = 0;
+  sw.Start();
+  for(size_t i = 0; i < games; i++) {
+    ConnectFour game = start;
+    while(!game.GameOver()) {
+      auto actions = game.GetAvailableActions();
+      game.ApplyAction(*select_randomly(actions.begin(), actions.end(), rng));
+      moves++;
+    }
+    score += game.Draw() ? 0 : 1;
+  }
+  sw.Stop();
+  std::cout << "ConnectFour\t1\t" << sw.ElapsedMillis() << "\t"
+            << moves / sw.ElapsedMillis() * 1000 << std::endl;
+
+  for(size_t batch_size : {1, 8, 64, 1024, 65536}) {
+    ConnectFourBatch batch(batch_size);
+    moves = 0;
+    double ms = 0;
+    for(size_t played = 0; played < games; played += batch_size) {
+      batch.Assign(start, batch_size);
+      sw.Start();
+      batch.RandomPlayouts(rng);
+      sw.Stop();
+      ms += sw.ElapsedMillis();
+      for(size_t i = 0; i < batch.size(); i++) {
+        moves += batch.NumMoves(i);
+      }
+    }
+    std::cout << "ConnectFourBatch\t" << batch_size << "\t" << ms << "\t"
+              << moves / ms * 1000 << std::endl;
+  }
+  sink = score;
+}
@@ -0,0 +1,76 @@
+#include <cstdlib>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "FlatHashMap.h"
+#include "Random.h"
+#include "Stopwatch.h"
+
+// Compares std::unordered_map with FlatHashMap as a state-key -> value
+// table: time per insert through operator[], per successful lookup in
+// random order, and per lookup when batches of eight are prefetched first.
+// Keys are random 49-bit values like ConnectFour state keys.
+//
+// usage: hash_table [max_entries]   (default 10^7; 10^8 needs ~10 GB)
+volatile float sink;
+
+template <class Map, bool prefetch>
+void Measure(char const* name, std::vector<uint64_t> const& keys,
+             std::vector<uint64_t> const& queries) {
+  Map map;
+  Stopwatch sw;
+  sw.Start();
+  for(uint64_t key : keys) {
+    map[key] = 1.0f;
+  }
+  sw.Stop();
+  double insert_ns = sw.ElapsedMillis() * 1e6 / keys.size();
+
+  float sum = 0;
+  sw.Start();
+  for(uint64_t key : queries) {
+    sum += map.find(key)->second;
+  }
+  sw.Stop();
+  double find_ns = sw.ElapsedMillis() * 1e6 / queries.size();
+
+  std::cout << keys.size() << "\t" << name << "\t" << insert_ns << "\t" << find_ns;
+  if constexpr(prefetch) {
+    const size_t batch = 8;
+    sw.Start();
+    for(size_t i = 0; i + batch <= queries.size(); i += batch) {
+      for(size_t j = 0; j < batch; j++) {
+        map.Prefetch(queries[i + j]);
+      }
+      for(size_t j = 0; j < batch; j++) {
+        sum += map.find(queries[i + j])->second;
+      }
+    }
+    sw.Stop();
+    std::cout << "\t" << sw.ElapsedMillis() * 1e6 / queries.size();
+  } else {
+    std::cout << "\t-";
+  }
+  std::cout << std::endl;
+  sink = sum;
+}
+
+int main(int argc, char* argv[]) {
+  size_t max_entries = argc > 1 ? std::atoll(argv[1]) : 10000000;
+  Xoshiro256 rng(1);
+
+  std::cout << "entries\tmap\tinsert_ns\tfind_ns\tprefetched_find_ns" << std::endl;
+  for(size_t n = 100000; n <= max_entries; n *= 10) {
+    std::vector<uint64_t> keys(n);
+    for(uint64_t& key : keys) {
+      key = rng() >> 15;
+    }
+    std::vector<uint64_t> queries(1000000);
+    for(uint64_t& query : queries) {
+      query = keys[rng.Below(n)];
+    }
+    Measure<std::unordered_map<uint64_t, float>, false>("unordered_map", keys, queries);
+    Measure<FlatHashMap<uint64_t, float>, true>("FlatHashMap", keys, queries);
+  }
+}
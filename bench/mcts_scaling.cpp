@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "ConnectFour.h"
+#include "MonteCarloTreeSearchAgent.h"
+#include "Stopwatch.h"
+
+// Measures MonteCarloTreeSearchAgent iteration throughput on the opening
+// ConnectFour position for 1, 2, 4, ... threads in both parallel modes.
+//
+// usage: mcts_scaling [max_threads] [iterations_per_thread] [moves]
+void Measure(MctsParallelism mode, size_t max_threads, size_t iterations, int moves) {
+  std::cout << (mode == MctsParallelism::ROOT ? "root" : "tree") << " parallel" << std::endl;
+  std::cout << "threads\titerations/s\tspeedup" << std::endl;
+  double baseline = 0;
+  for(size_t threads = 1; threads <= max_threads; threads *= 2) {
+    MonteCarloTreeSearchAgent<ConnectFour> agent;
+    agent.SetIterationLimit(iterations);
+    agent.SetTreeReuse(false);
+    agent.SetParallelism(mode);
+    agent.SetThreadCount(threads);
+
+    ConnectFour game;
+    agent.GetAction(game);  // warm up arenas and threads
+
+    Stopwatch sw;
+    sw.Start();
+    for(int move = 0; move < moves; move++) {
+      agent.GetAction(game);
+    }
+    sw.Stop();
+
+    double rate = moves * iterations * threads / sw.ElapsedMillis() * 1000;
+    if(threads == 1) {
+      baseline = rate;
+    }
+    std::cout << threads << "\t" << rate << "\t" << rate / baseline << std::endl;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  size_t max_threads = argc > 1 ? std::atoi(argv[1])
+                                : std::max(1u, std::thread::hardware_concurrency());
+  size_t iterations = argc > 2 ? std::atoi(argv[2]) : 20000;
+  int moves = argc > 3 ? std::atoi(argv[3]) : 5;
+
+  Measure(MctsParallelism::ROOT, max_threads, iterations, moves);
+  Measure(MctsParallelism::TREE, max_threads, iterations, moves);
+}
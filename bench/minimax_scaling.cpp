@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "ConnectFour.h"
+#include "MinimaxAgent.h"
+#include "Stopwatch.h"
+
+// Measures alpha-beta MinimaxAgent throughput and time to reach a fixed
+// depth on the opening ConnectFour position for 1, 2, 4, ... threads.
+//
+// usage: minimax_scaling [max_threads] [depth] [table_entries]
+
+// Pieces in the centre column, from the point of view of the side to move.
+int CentreControl(const ConnectFour& game) {
+  char own = game.FirstPlayersTurn() ? 'x' : 'o';
+  int score = 0;
+  for(int row = 0; row < CONNECT_FOUR_NUM_ROWS; row++) {
+    char cell = game.GetCell(row, CONNECT_FOUR_NUM_COLS / 2);
+    if(cell != '-') {
+      score += cell == own ? 1 : -1;
+    }
+  }
+  return score;
+}
+
+int main(int argc, char* argv[]) {
+  size_t max_threads = argc > 1 ? std::atoi(argv[1])
+                                : std::max(1u, std::thread::hardware_concurrency());
+  int depth = argc > 2 ? std::atoi(argv[2]) : 14;
+  size_t table_entries = argc > 3 ? std::atoll(argv[3]) : 1 << 22;
+
+  std::cout << "threads\tdepth\tms\tnodes\tnodes/s\tspeedup" << std::endl;
+  double baseline = 0;
+  for(size_t threads = 1; threads <= max_threads; threads *= 2) {
+    MinimaxAgent<ConnectFour> agent;
+    agent.SetAlphaBeta(true);
+    agent.SetTranspositionTableSize(table_entries);
+    agent.SetEvaluation(CentreControl);
+    agent.SetDepthLimit(depth);
+    agent.SetThreadCount(threads);
+
+    ConnectFour game;
+    Stopwatch sw;
+    sw.Start();
+    agent.GetAction(game);
+    sw.Stop();
+
+    double ms = sw.ElapsedMillis();
+    if(threads == 1) {
+      baseline = ms;
+    }
+    std::cout << threads << "\t" << agent.CompletedDepth() << "\t" << ms << "\t"
+              << agent.NodesSearched() << "\t" << agent.NodesSearched() / ms * 1000 << "\t"
+              << baseline / ms << std::endl;
+  }
+}
@@ -0,0 +1,63 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "ConnectFour.h"
+#include "GameSession.h"
+#include "NTupleAgent.h"
+#include "Random.h"
+#include "Stopwatch.h"
+
+// Trains an NTupleAgent on ConnectFour by self-play and after every round
+// reports training speed and how often the greedy policy beats a uniformly
+// random opponent from each side.
+//
+// usage: ntuple_training [rounds] [games_per_round] [learning_rate]
+double WinRateAgainstRandom(NTupleAgent<ConnectFour>& agent, bool agent_first, int games) {
+  int wins = 0;
+  for(int count = 0; count < games; count++) {
+    ConnectFour game;
+    while(!game.GameOver()) {
+      if(game.FirstPlayersTurn() == agent_first) {
+        agent.TakeAction(game);
+      } else {
+        auto actions = game.GetAvailableActions();
+        game.ApplyAction(*select_randomly(actions.begin(), actions.end()));
+      }
+    }
+    wins += !game.Draw() && (game.GetGameStatus() == ConnectFourStatus::X_WINS) == agent_first;
+  }
+  return 100.0 * wins / games;
+}
+
+int main(int argc, char* argv[]) {
+  int rounds = argc > 1 ? std::atoi(argv[1]) : 5;
+  int games = argc > 2 ? std::atoi(argv[2]) : 20000;
+  float learning_rate = argc > 3 ? std::atof(argv[3]) : 0.1f;
+  SeedThreadRng(1);
+
+  NTupleNetwork<ConnectFour> network;
+  NTupleAgent<ConnectFour> agent1(&network), agent2(&network);
+  for(NTupleAgent<ConnectFour>* agent : {&agent1, &agent2}) {
+    agent->SetLearningRate(learning_rate);
+    agent->SetExplorationRate(0.1);
+  }
+  NTupleAgent<ConnectFour> greedy(&network);
+  greedy.SetLearningRate(0);
+  greedy.SetExplorationRate(0);
+
+  ConnectFour game;
+  GameSession<ConnectFour, NTupleAgent, NTupleAgent> session(game, agent1, agent2);
+  std::cout << network.NumTuples() << " tuples, " << network.NumWeights() << " weights" << std::endl;
+  std::cout << "games\tgames/s\twin%_first\twin%_second" << std::endl;
+  for(int round = 1; round <= rounds; round++) {
+    Stopwatch sw;
+    sw.Start();
+    for(int count = 0; count < games; count++) {
+      session.PlayOnce();
+    }
+    sw.Stop();
+    std::cout << round * games << "\t" << games / sw.ElapsedMillis() * 1000 << "\t"
+              << WinRateAgainstRandom(greedy, true, 500) << "\t"
+              << WinRateAgainstRandom(greedy, false, 500) << std::endl;
+  }
+}
@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "ConcurrentValueTable.h"
+#include "MinimaxAgent.h"
+#include "SelfPlayTrainer.h"
+#include "Stopwatch.h"
+#include "TemporalDifferenceAgent.h"
+#include "TicTacToe.h"
+
+// Measures SelfPlayTrainer throughput on TicTacToe for 1, 2, 4, ...
+// threads, and checks the quality of each trained policy by letting it play
+// greedily against a perfect player from both sides.
+//
+// usage: selfplay_scaling [max_threads] [games]
+int LossesAgainstPerfectPlay(ConcurrentValueTable* values, ConcurrentValueTable* terminal_values) {
+  TemporalDifferenceAgent<TicTacToe, ConcurrentValueTable> learner(values, terminal_values);
+  learner.SetExplorationRate(0);
+  learner.SetLearningRate(0);
+  MinimaxAgent<TicTacToe> perfect;
+  int losses = 0;
+  for(bool learner_first : {true, false}) {
+    TicTacToe game;
+    while(!game.GameOver()) {
+      if(game.FirstPlayersTurn() == learner_first) {
+        learner.TakeAction(game);
+      } else {
+        perfect.TakeAction(game);
+      }
+    }
+    losses += !game.Draw();
+  }
+  return losses;
+}
+
+int main(int argc, char* argv[]) {
+  size_t max_threads = argc > 1 ? std::atoi(argv[1])
+                                : std::max(1u, std::thread::hardware_concurrency());
+  size_t games = argc > 2 ? std::atoi(argv[2]) : 200000;
+
+  std::cout << "threads\tgames/s\tspeedup\tentries\tlosses" << std::endl;
+  double baseline = 0;
+  for(size_t threads = 1; threads <= max_threads; threads *= 2) {
+    ConcurrentValueTable values, terminal_values;
+    SelfPlayTrainer<TicTacToe> trainer(&values, &terminal_values);
+    trainer.SetExplorationRate(1.0);
+    trainer.SetLearningRate(1);
+    trainer.SetSeed(1);
+    trainer.SetThreadCount(threads);
+
+    Stopwatch sw;
+    sw.Start();
+    bool complete = trainer.Train(games);
+    sw.Stop();
+    if(!complete) {
+      std::cerr << "value table full after " << values.size() << " entries" << std::endl;
+    }
+
+    double rate = games / sw.ElapsedMillis() * 1000;
+    if(threads == 1) {
+      baseline = rate;
+    }
+    std::cout << threads << "\t" << rate << "\t" << rate / baseline << "\t"
+              << values.size() << "\t" << LossesAgainstPerfectPlay(&values, &terminal_values)
+              << std::endl;
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-capacity list of actions that lives on the stack. Games size it to
+// their maximum branching factor so that action generation never touches
+// the heap.
+template <class Action, std::size_t Capacity>
+class ActionList {
+public:
+  using value_type = Action;
+  using iterator = Action*;
+  using const_iterator = const Action*;
+
+  ActionList() : size_(0) { }
+
+  void push_back(Action const& action) {
+    items_[size_++] = action;
+  }
+
+  void pop_back() {
+    --size_;
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+  Action& back() {
+    return items_[size_ - 1];
+  }
+
+  Action const& back() const {
+    return items_[size_ - 1];
+  }
+
+  Action& operator[](std::size_t index) {
+    return items_[index];
+  }
+
+  Action const& operator[](std::size_t index) const {
+    return items_[index];
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  static constexpr std::size_t capacity() {
+    return Capacity;
+  }
+
+  iterator begin() { return items_; }
+  iterator end() { return items_ + size_; }
+  const_iterator begin() const { return items_; }
+  const_iterator end() const { return items_ + size_; }
+
+private:
+  Action items_[Capacity];
+  uint32_t size_;
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+// Fixed-capacity uint64_t -> float map that many threads may read, insert
+// into and update at once without locks. It mirrors the part of
+// std::unordered_map that TemporalDifferenceAgent uses: operator[] inserts
+// a zero entry for a new key and returns a reference whose loads, stores
+// and += are atomic. Keys are placed by linear probing and are never
+// removed; ~0 is reserved to mark empty slots. Once the table is full, new
+// keys are not stored and full() reports it.
+class ConcurrentValueTable {
+  struct Slot {
+    std::atomic<uint64_t> key;
+    std::atomic<uint32_t> value;  // float bits
+  };
+
+public:
+  static const uint64_t kEmptyKey = ~uint64_t(0);
+
+  class Reference {
+  public:
+    operator float() const {
+      return ToFloat(slot_->value.load(std::memory_order_relaxed));
+    }
+
+    Reference& operator=(float value) {
+      slot_->value.store(ToBits(value), std::memory_order_relaxed);
+      return *this;
+    }
+
+    // Atomically adds delta and returns the new value.
+    float operator+=(float delta) {
+      uint32_t bits = slot_->value.load(std::memory_order_relaxed);
+      float value;
+      do {
+        value = ToFloat(bits) + delta;
+      } while(!slot_->value.compare_exchange_weak(bits, ToBits(value), std::memory_order_relaxed));
+      return value;
+    }
+
+  private:
+    friend class ConcurrentValueTable;
+    explicit Reference(Slot* slot) : slot_(slot) { }
+    Slot* slot_;
+  };
+
+  // Visits occupied slots as (key, value) pairs. Entries inserted during the
+  // iteration may or may not be seen.
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<uint64_t, float>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    value_type operator*() const {
+      return {slot_->key.load(std::memory_order_relaxed),
+              ToFloat(slot_->value.load(std::memory_order_relaxed))};
+    }
+
+    const_iterator& operator++() {
+      ++slot_;
+      SkipEmpty();
+      return *this;
+    }
+
+    bool operator==(const_iterator const& other) const { return slot_ == other.slot_; }
+    bool operator!=(const_iterator const& other) const { return slot_ != other.slot_; }
+
+  private:
+    friend class ConcurrentValueTable;
+    const_iterator(Slot const* slot, Slot const* end) : slot_(slot), end_(end) {
+      SkipEmpty();
+    }
+
+    void SkipEmpty() {
+      while(slot_ != end_ && slot_->key.load(std::memory_order_relaxed) == kEmptyKey) {
+        ++slot_;
+      }
+    }
+
+    Slot const* slot_;
+    Slot const* end_;
+  };
+
+  // Room for at least capacity keys at a load factor of one half at most.
+  explicit ConcurrentValueTable(size_t capacity = 1 << 16) {
+    size_t num_slots = 16;
+    while(num_slots < 2 * capacity) {
+      num_slots *= 2;
+    }
+    mask_ = num_slots - 1;
+    slots_.reset(new Slot[num_slots]);
+    clear();
+  }
+
+  // Finds key, inserting it with value 0 if it is missing. Once capacity()
+  // keys are stored, which keeps the load factor at one half, the table is
+  // marked full and a missing key gets a scratch slot of the calling
+  // thread instead, which reads as 0 and forgets what is written to it.
+  Reference operator[](uint64_t key) {
+    for(size_t i = Index(key), probes = 0; probes <= mask_; i = (i + 1) & mask_, probes++) {
+      Slot& slot = slots_[i];
+      uint64_t found = slot.key.load(std::memory_order_acquire);
+      if(found == kEmptyKey) {
+        // Reserve room for the key before claiming the slot.
+        if(size_.fetch_add(1, std::memory_order_relaxed) >= capacity()) {
+          size_.fetch_sub(1, std::memory_order_relaxed);
+          break;
+        }
+        if(slot.key.compare_exchange_strong(found, key, std::memory_order_acq_rel)) {
+          return Reference(&slot);
+        }
+        size_.fetch_sub(1, std::memory_order_relaxed);
+      }
+      if(found == key) {
+        return Reference(&slot);
+      }
+    }
+    full_.store(true, std::memory_order_relaxed);
+    static thread_local Slot scratch;
+    scratch.value.store(0, std::memory_order_relaxed);
+    return Reference(&scratch);
+  }
+
+  // Value stored for key, or 0 without inserting it.
+  float Get(uint64_t key) const {
+    for(size_t i = Index(key), probes = 0; probes <= mask_; i = (i + 1) & mask_, probes++) {
+      uint64_t found = slots_[i].key.load(std::memory_order_acquire);
+      if(found == key) {
+        return ToFloat(slots_[i].value.load(std::memory_order_relaxed));
+      }
+      if(found == kEmptyKey) {
+        break;
+      }
+    }
+    return 0.0f;
+  }
+
+  void Prefetch(uint64_t key) const {
+    __builtin_prefetch(&slots_[Index(key)]);
+  }
+
+  size_t count(uint64_t key) const {
+    for(size_t i = Index(key), probes = 0; probes <= mask_; i = (i + 1) & mask_, probes++) {
+      uint64_t found = slots_[i].key.load(std::memory_order_acquire);
+      if(found == key) {
+        return 1;
+      }
+      if(found == kEmptyKey) {
+        break;
+      }
+    }
+    return 0;
+  }
+
+  // Not safe to call while other threads use the table.
+  void clear() {
+    for(size_t i = 0; i <= mask_; i++) {
+      slots_[i].key.store(kEmptyKey, std::memory_order_relaxed);
+      slots_[i].value.store(0, std::memory_order_relaxed);
+    }
+    size_.store(0, std::memory_order_relaxed);
+    full_.store(false, std::memory_order_relaxed);
+  }
+
+  size_t size() const {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  size_t capacity() const {
+    return (mask_ + 1) / 2;
+  }
+
+  // True once a key could not be inserted since the last clear().
+  bool full() const {
+    return full_.load(std::memory_order_relaxed);
+  }
+
+  const_iterator begin() const {
+    return const_iterator(slots_.get(), slots_.get() + mask_ + 1);
+  }
+
+  const_iterator end() const {
+    return const_iterator(slots_.get() + mask_ + 1, slots_.get() + mask_ + 1);
+  }
+
+private:
+  static float ToFloat(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  static uint32_t ToBits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  size_t Index(uint64_t key) const {
+    return (key * 0x9E3779B97F4A7C15ull) >> 20 & mask_;
+  }
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+  std::atomic<size_t> size_;
+  std::atomic<bool> full_;
+};
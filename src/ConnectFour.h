@@ -1,9 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
 #include <string>
-#include <vector>
 #include <Eigen/Dense>
 
+#include "ActionList.h"
+
 #define CONNECT_FOUR_NUM_ROWS 6
 #define CONNECT_FOUR_NUM_COLS 7
 
@@ -30,26 +35,60 @@ std::string to_string(ConnectFourStatus status) {
 
 struct ConnectFourAction {
   int column_index;
+
+  bool operator==(const ConnectFourAction &other) const {
+    return column_index == other.column_index;
+  }
 };
 
 std::string to_string(ConnectFourAction const& action) {
     return "{" + std::to_string(action.column_index) + "}";
 }
 
+// Bitboard layout: each column occupies kColumnStride bits, bottom row first,
+// with one spare sentinel bit on top so that shifts never carry a line from
+// one column into the next.
+//
+//   6 13 20 27 34 41 48   <- sentinel
+//   5 12 19 26 33 40 47   <- row 0 (top)
+//   ...
+//   0  7 14 21 28 35 42   <- row 5 (bottom)
 class ConnectFour {
  public:
   using Action = ConnectFourAction;
   using Status = ConnectFourStatus;
+  using Actions = ActionList<ConnectFourAction, CONNECT_FOUR_NUM_COLS>;
   using BoardStateType = Eigen::Matrix<char,
                                        CONNECT_FOUR_NUM_ROWS,
                                        CONNECT_FOUR_NUM_COLS>;
 
   ConnectFour(std::string const& state) {
+    Reset();
+    for (int col = 0; col < num_cols; ++col) {
+      // Eigen storage is column major with row 0 at the top.
+      for (int row = num_rows - 1; row >= 0; --row) {
+        char cell = state[col * num_rows + row];
+        if (cell == '-') {
+          break;
+        }
+        uint64_t bit = CellBit(heights_[col]++, col);
+        mask_ |= bit;
+        if (cell == 'x') {
+          x_mask_ |= bit;
+        }
+        ++num_moves_;
+      }
+    }
     size_t num_x = std::count(state.begin(), state.end(), 'x');
     size_t num_o = std::count(state.begin(), state.end(), 'o');
     x_turn = !(num_x == num_o + 1);
-    memcpy(board_state_.data(), state.c_str(), string_size);
-    game_status_ = UpdateConnectFourStatus();
+    if (IsWin(x_mask_)) {
+      game_status_ = ConnectFourStatus::X_WINS;
+    } else if (IsWin(mask_ ^ x_mask_)) {
+      game_status_ = ConnectFourStatus::O_WINS;
+    } else if (num_moves_ == num_rows * num_cols) {
+      game_status_ = ConnectFourStatus::DRAW;
+    }
   }
 
   ConnectFour() {
@@ -57,26 +96,43 @@ class ConnectFour {
   }
 
   BoardStateType GetBoardState() const {
-    return board_state_;
+    BoardStateType board_state;
+    for (int row = 0; row < num_rows; ++row) {
+      for (int col = 0; col < num_cols; ++col) {
+        board_state(row, col) = GetCell(row, col);
+      }
+    }
+    return board_state;
+  }
+
+  char GetCell(int row, int col) const {
+    uint64_t bit = CellBit(num_rows - 1 - row, col);
+    if (!(mask_ & bit)) {
+      return '-';
+    }
+    return (x_mask_ & bit) ? 'x' : 'o';
   }
 
   void PrintGame() const {
-    std::cout << board_state_ << std::endl << to_string(game_status_) << std::endl;
+    std::cout << GetBoardState() << std::endl << to_string(game_status_) << std::endl;
   }
 
   void Reset() {
     game_status_ = ConnectFourStatus::IN_PROGRESS;
-    board_state_.fill('-');
+    x_mask_ = 0;
+    mask_ = 0;
+    std::fill(heights_, heights_ + num_cols, 0);
+    num_moves_ = 0;
     x_turn = true;
   }
 
-  std::vector<ConnectFourAction> GetAvailableActions() const {
-    std::vector<ConnectFourAction> actions;
+  Actions GetAvailableActions() const {
+    Actions actions;
     if(GameOver()) {
       return actions;
     }
     for (int col = 0; col < num_cols; ++col) {
-      if (board_state_(0, col) == '-') {
+      if (heights_[col] < num_rows) {
         actions.push_back({col});
       }
     }
@@ -84,14 +140,42 @@ class ConnectFour {
     return actions;
   }
 
+  // Search-order hint: central columns take part in more lines.
+  int MovePriority(ConnectFourAction const& action) const {
+    return num_cols / 2 - std::abs(action.column_index - num_cols / 2);
+  }
+
+  // Bit i is set when column i can still be played.
+  unsigned GetLegalMoveMask() const {
+    if (GameOver()) {
+      return 0;
+    }
+    unsigned legal = 0;
+    for (int col = 0; col < num_cols; ++col) {
+      legal |= (heights_[col] < num_rows) << col;
+    }
+    return legal;
+  }
+
   float ApplyAction(ConnectFourAction const & action) {
-    int row = num_rows - 1;
-    while (!(board_state_(row, action.column_index) == '-')) {
-      --row;
+    int col = action.column_index;
+    uint64_t bit = CellBit(heights_[col]++, col);
+    mask_ |= bit;
+    ++num_moves_;
+    // Only the player who just moved can have completed a line.
+    if (x_turn) {
+      x_mask_ |= bit;
+      if (IsWin(x_mask_)) {
+        game_status_ = ConnectFourStatus::X_WINS;
+      }
+    } else if (IsWin(mask_ ^ x_mask_)) {
+      game_status_ = ConnectFourStatus::O_WINS;
+    }
+    if (game_status_ == ConnectFourStatus::IN_PROGRESS &&
+        num_moves_ == num_rows * num_cols) {
+      game_status_ = ConnectFourStatus::DRAW;
     }
-    board_state_(row, action.column_index) = x_turn ? 'x' : 'o';
     x_turn = !x_turn;
-    game_status_ = UpdateConnectFourStatus();
     return GetReward();
   }
 
@@ -125,78 +209,102 @@ class ConnectFour {
   }
 
   std::string GetStateString() const {
-    return std::string(board_state_.data(), string_size);
+    std::string state(string_size, '-');
+    for (int col = 0; col < num_cols; ++col) {
+      for (int row = 0; row < num_rows; ++row) {
+        state[col * num_rows + row] = GetCell(row, col);
+      }
+    }
+    return state;
+  }
+
+  // Perfect 49-bit encoding of the position: in each column the stones of x
+  // sit below a single marker bit one above the column height.
+  uint64_t GetStateKey() const {
+    return x_mask_ + mask_ + kBottomMask;
+  }
+
+  // The smaller of the keys of the position and of its left-right mirror
+  // image, so that both share one table entry.
+  uint64_t GetCanonicalKey() const {
+    uint64_t key = GetStateKey();
+    return std::min(key, MirrorKey(key));
   }
 
+  // 1 when the mirror image is the canonical one, otherwise 0.
+  int GetCanonicalSymmetry() const {
+    uint64_t key = GetStateKey();
+    return MirrorKey(key) < key;
+  }
+
+  // Maps an action on this position to the matching action on its image
+  // under symmetry, and back.
+  static ConnectFourAction TransformAction(ConnectFourAction const& action, int symmetry) {
+    return {symmetry ? num_cols - 1 - action.column_index : action.column_index};
+  }
+
+  static ConnectFourAction InverseTransformAction(ConnectFourAction const& action, int symmetry) {
+    return TransformAction(action, symmetry);
+  }
+
+  static constexpr int num_symmetries = 2;
+
  private:
-  bool DidPlayerWin(char player) const {
+  friend class ConnectFourBatch;
+
+  static constexpr int kColumnStride = CONNECT_FOUR_NUM_ROWS + 1;
+  static constexpr uint64_t kBottomMask = 0x0040810204081ull;
+
+  // Reverses the order of the columns of a key.
+  static uint64_t MirrorKey(uint64_t key) {
+    constexpr uint64_t column_mask = (uint64_t(1) << kColumnStride) - 1;
+    uint64_t mirrored = 0;
+    for (int col = 0; col < num_cols; ++col) {
+      mirrored |= ((key >> (col * kColumnStride)) & column_mask)
+                  << ((num_cols - 1 - col) * kColumnStride);
+    }
+    return mirrored;
+  }
+
+  static uint64_t CellBit(int height, int col) {
+    return uint64_t(1) << (col * kColumnStride + height);
+  }
+
+  static bool IsWin(uint64_t stones) {
     // Vertical lines
-    for (int row=0; row < num_rows-3; ++row) {
-      for (int col=0; col < num_cols; ++col) {
-        if (board_state_(row+0, col) == player &&
-            board_state_(row+1, col) == player &&
-            board_state_(row+2, col) == player &&
-            board_state_(row+3, col) == player)
-          return true;
-      }
+    uint64_t pairs = stones & (stones >> 1);
+    if (pairs & (pairs >> 2)) {
+      return true;
     }
     // Horizontal lines
-    for (int row=0; row < num_rows; ++row) {
-      for (int col=0; col < num_cols-3; ++col) {
-        if (board_state_(row, col+0) == player &&
-            board_state_(row, col+1) == player &&
-            board_state_(row, col+2) == player &&
-            board_state_(row, col+3) == player)
-          return true;
-      }
+    pairs = stones & (stones >> kColumnStride);
+    if (pairs & (pairs >> (2 * kColumnStride))) {
+      return true;
     }
-    // Ascending diagional
-    for (int row=0; row < num_rows-3; ++row) {
-      for (int col=0; col < num_cols-3; ++col) {
-        if (board_state_(row+0, col+0) == player &&
-            board_state_(row+1, col+1) == player &&
-            board_state_(row+2, col+2) == player &&
-            board_state_(row+3, col+3) == player)
-          return true;
-      }
+    // Descending diagonal
+    pairs = stones & (stones >> (kColumnStride - 1));
+    if (pairs & (pairs >> (2 * (kColumnStride - 1)))) {
+      return true;
     }
-    // Descending diagional
-    for (int row=0; row < num_rows-3; ++row) {
-      for (int col=0; col < num_cols-3; ++col) {
-        if (board_state_(row+3, col+0) == player &&
-            board_state_(row+2, col+1) == player &&
-            board_state_(row+1, col+2) == player &&
-            board_state_(row+0, col+3) == player)
-          return true;
-      }
+    // Ascending diagonal
+    pairs = stones & (stones >> (kColumnStride + 1));
+    if (pairs & (pairs >> (2 * (kColumnStride + 1)))) {
+      return true;
     }
     return false;
   }
 
-  ConnectFourStatus UpdateConnectFourStatus() {
-    if (DidPlayerWin('x')) {
-      return ConnectFourStatus::X_WINS;
-    }
-    if (DidPlayerWin('o')) {
-      return ConnectFourStatus::O_WINS;
-    }
-
-    if (BoardFull()) {
-      return ConnectFourStatus::DRAW;
-    }
-
-    return ConnectFourStatus::IN_PROGRESS;
-  }
-
-  bool BoardFull() const {
-    auto actions = GetAvailableActions();
-    return (actions.size() == 0);
-  }
-
-  BoardStateType board_state_;
+  uint64_t x_mask_;
+  uint64_t mask_;
   ConnectFourStatus game_status_;
-  const int num_rows = CONNECT_FOUR_NUM_ROWS;
-  const int num_cols = CONNECT_FOUR_NUM_COLS;
-  const int string_size = num_rows * num_cols;
+  uint8_t heights_[CONNECT_FOUR_NUM_COLS];
+  uint8_t num_moves_;
   bool x_turn;
+  static constexpr int num_rows = CONNECT_FOUR_NUM_ROWS;
+  static constexpr int num_cols = CONNECT_FOUR_NUM_COLS;
+  static constexpr int string_size = num_rows * num_cols;
 };
+
+// Batched boards and the RandomPlayoutScore overload that MCTS picks up for
+// ConnectFour.
+#include "ConnectFourBatch.h"
@@ -0,0 +1,401 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "ConnectFour.h"
+#include "Random.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define CONNECT_FOUR_BATCH_AVX2 1
+#endif
+
+// Structure-of-arrays container of many ConnectFour boards that are stepped
+// together. Boards use the bitboard layout of ConnectFour; each keeps the
+// stones of the side to move and the occupancy mask, so a move is an add,
+// an AND and an XOR, and the hot loops run over plain arrays.
+//
+// On x86-64 the loops are compiled for AVX2 as well and the AVX2 version is
+// picked at run time when the CPU supports it; RandomPlayouts additionally
+// has a hand-written AVX2 kernel that plays four boards per vector with
+// four interleaved xoshiro256** streams.
+class ConnectFourBatch {
+public:
+  ConnectFourBatch() { }
+
+  explicit ConnectFourBatch(size_t capacity) {
+    stones_.reserve(capacity);
+    mask_.reserve(capacity);
+    moves_.reserve(capacity);
+    status_.reserve(capacity);
+  }
+
+  void Add(ConnectFour const& game) {
+    stones_.push_back(game.x_turn ? game.x_mask_ : game.mask_ ^ game.x_mask_);
+    mask_.push_back(game.mask_);
+    moves_.push_back(game.num_moves_);
+    status_.push_back(uint8_t(game.game_status_));
+  }
+
+  // Fills the batch with count copies of game.
+  void Assign(ConnectFour const& game, size_t count) {
+    stones_.assign(count, game.x_turn ? game.x_mask_ : game.mask_ ^ game.x_mask_);
+    mask_.assign(count, game.mask_);
+    moves_.assign(count, game.num_moves_);
+    status_.assign(count, uint8_t(game.game_status_));
+  }
+
+  void Clear() {
+    stones_.clear();
+    mask_.clear();
+    moves_.clear();
+    status_.clear();
+  }
+
+  size_t size() const {
+    return mask_.size();
+  }
+
+  ConnectFourStatus GetGameStatus(size_t board) const {
+    return ConnectFourStatus(status_[board]);
+  }
+
+  bool FirstPlayersTurn(size_t board) const {
+    return moves_[board] % 2 == 0;
+  }
+
+  int NumMoves(size_t board) const {
+    return moves_[board];
+  }
+
+  // Bit c of masks[i] is set when column c of board i can be played, as in
+  // ConnectFour::GetLegalMoveMask.
+  void GetLegalMoveMasks(uint8_t* masks) const {
+    LegalMoveMasks(mask_.data(), status_.data(), size(), masks);
+  }
+
+  // Plays columns[i] on board i for every board still in progress and
+  // updates its status. The columns must be legal.
+  void ApplyActions(uint8_t const* columns) {
+    ApplyColumns(stones_.data(), mask_.data(), moves_.data(), status_.data(), size(), columns);
+  }
+
+  // Plays every board to the end with uniformly random moves. The streams
+  // are seeded from rng.
+  void RandomPlayouts(Xoshiro256& rng) {
+#ifdef CONNECT_FOUR_BATCH_AVX2
+    if(size() >= 8 && __builtin_cpu_supports("avx2")) {
+      PlayoutsAvx2(rng);
+      return;
+    }
+#endif
+    for(size_t board = 0; board < size(); board++) {
+      PlayoutScalar(board, rng);
+    }
+  }
+
+  // Number of boards won by the first player, the second player and drawn.
+  void CountResults(size_t& x_wins, size_t& o_wins, size_t& draws) const {
+    x_wins = o_wins = draws = 0;
+    for(uint8_t status : status_) {
+      x_wins += status == uint8_t(ConnectFourStatus::X_WINS);
+      o_wins += status == uint8_t(ConnectFourStatus::O_WINS);
+      draws += status == uint8_t(ConnectFourStatus::DRAW);
+    }
+  }
+
+private:
+  static constexpr int kStride = 7;
+  static constexpr int kCells = CONNECT_FOUR_NUM_ROWS * CONNECT_FOUR_NUM_COLS;
+  static constexpr uint64_t kBottomMask = 0x0040810204081ull;
+  static constexpr uint64_t kBoardMask = kBottomMask * 0x3F;
+  static constexpr uint64_t kTopRowMask = kBottomMask << (CONNECT_FOUR_NUM_ROWS - 1);
+  static constexpr uint8_t kInProgress = uint8_t(ConnectFourStatus::IN_PROGRESS);
+
+  static uint64_t LineMask(uint64_t stones, int shift) {
+    uint64_t pairs = stones & (stones >> shift);
+    return pairs & (pairs >> (2 * shift));
+  }
+
+  static uint64_t Wins(uint64_t stones) {
+    return LineMask(stones, 1) | LineMask(stones, kStride) |
+           LineMask(stones, kStride - 1) | LineMask(stones, kStride + 1);
+  }
+
+  // Gathers the top-row bits, spaced kStride apart, into seven adjacent
+  // bits. The shifted copies never overlap, so no carries disturb them.
+  static uint8_t CompressTopRow(uint64_t open) {
+    uint64_t spaced = open >> (CONNECT_FOUR_NUM_ROWS - 1);
+    uint64_t gathered = 0;
+    for(int j = 0; j < CONNECT_FOUR_NUM_COLS; j++) {
+      gathered |= spaced << (6 * j);
+    }
+    return (gathered >> 36) & 0x7F;
+  }
+
+  // The loops below are written without data-dependent branches so that
+  // they vectorise.
+#ifdef CONNECT_FOUR_BATCH_AVX2
+  __attribute__((target_clones("avx2", "default")))
+#endif
+  static void LegalMoveMasks(uint64_t const* mask, uint8_t const* status, size_t n, uint8_t* out) {
+    for(size_t i = 0; i < n; i++) {
+      uint8_t legal = CompressTopRow(~mask[i] & kTopRowMask);
+      out[i] = status[i] == kInProgress ? legal : 0;
+    }
+  }
+
+#ifdef CONNECT_FOUR_BATCH_AVX2
+  __attribute__((target_clones("avx2", "default")))
+#endif
+  static void ApplyColumns(uint64_t* stones, uint64_t* mask, uint8_t* moves, uint8_t* status,
+                           size_t n, uint8_t const* columns) {
+    for(size_t i = 0; i < n; i++) {
+      bool live = status[i] == kInProgress;
+      uint64_t column_mask = uint64_t(0x3F) << (kStride * columns[i]);
+      uint64_t move = (mask[i] + kBottomMask) & column_mask & (live ? kBoardMask : 0);
+      uint64_t mover = stones[i] | move;
+      uint64_t occupied = mask[i] | move;
+      uint8_t played = moves[i] + live;
+      uint8_t winner = moves[i] % 2 == 0 ? uint8_t(ConnectFourStatus::X_WINS)
+                                         : uint8_t(ConnectFourStatus::O_WINS);
+      uint8_t result = Wins(mover) ? winner
+                     : played == kCells ? uint8_t(ConnectFourStatus::DRAW)
+                     : kInProgress;
+      status[i] = live ? result : status[i];
+      stones[i] = live ? occupied ^ mover : stones[i];
+      mask[i] = occupied;
+      moves[i] = played;
+    }
+  }
+
+  void PlayoutScalar(size_t board, Xoshiro256& rng) {
+    uint64_t stones = stones_[board];
+    uint64_t mask = mask_[board];
+    uint8_t moves = moves_[board];
+    uint8_t status = status_[board];
+    while(status == kInProgress) {
+      uint64_t possible = (mask + kBottomMask) & kBoardMask;
+      uint64_t move;
+      do {
+        move = possible & (uint64_t(0x3F) << (kStride * rng.Below(CONNECT_FOUR_NUM_COLS)));
+      } while(!move);
+      uint64_t mover = stones | move;
+      mask |= move;
+      if(Wins(mover)) {
+        status = uint8_t(moves % 2 == 0 ? ConnectFourStatus::X_WINS : ConnectFourStatus::O_WINS);
+      } else if(moves + 1 == kCells) {
+        status = uint8_t(ConnectFourStatus::DRAW);
+      }
+      stones = mask ^ mover;
+      moves++;
+    }
+    stones_[board] = stones;
+    mask_[board] = mask;
+    moves_[board] = moves;
+    status_[board] = status;
+  }
+
+#ifdef CONNECT_FOUR_BATCH_AVX2
+  __attribute__((target("avx2")))
+  static __m256i NonZero(__m256i x) {
+    return _mm256_xor_si256(_mm256_cmpeq_epi64(x, _mm256_setzero_si256()),
+                            _mm256_set1_epi64x(-1));
+  }
+
+  template <int shift>
+  __attribute__((target("avx2")))
+  static __m256i LineMask(__m256i stones) {
+    __m256i pairs = _mm256_and_si256(stones, _mm256_srli_epi64(stones, shift));
+    return _mm256_and_si256(pairs, _mm256_srli_epi64(pairs, 2 * shift));
+  }
+
+  template <int k>
+  __attribute__((target("avx2")))
+  static __m256i Rotl(__m256i x) {
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+  }
+
+  static constexpr int kGroups = 2;
+
+  // Four boards in the 64-bit lanes of a vector, each with its own
+  // xoshiro256** stream. board[lane] is the board held by the lane, or -1.
+  struct Lanes {
+    __m256i stones, mask, moves, status, live;
+    __m256i s0, s1, s2, s3;
+    int64_t board[4];
+    int occupied;  // bit per lane holding a board
+  };
+
+  // Writes boards whose game ended back to the arrays and loads the next
+  // unplayed boards into their lanes.
+  __attribute__((target("avx2"), noinline, cold))
+  void Refill(Lanes& lanes, size_t& next, size_t end) {
+    alignas(32) uint64_t stones[4], mask[4], moves[4], status[4], live[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(stones), lanes.stones);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(mask), lanes.mask);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(moves), lanes.moves);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(status), lanes.status);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(live), lanes.live);
+    for(int lane = 0; lane < 4; lane++) {
+      if(live[lane]) {
+        continue;
+      }
+      if(lanes.board[lane] >= 0) {
+        size_t board = lanes.board[lane];
+        stones_[board] = stones[lane];
+        mask_[board] = mask[lane];
+        moves_[board] = moves[lane];
+        status_[board] = status[lane];
+        lanes.board[lane] = -1;
+        lanes.occupied &= ~(1 << lane);
+      }
+      for(; next < end; next++) {
+        if(status_[next] == kInProgress) {
+          break;
+        }
+      }
+      if(next < end) {
+        lanes.board[lane] = next;
+        lanes.occupied |= 1 << lane;
+        stones[lane] = stones_[next];
+        mask[lane] = mask_[next];
+        moves[lane] = moves_[next];
+        status[lane] = kInProgress;
+        live[lane] = ~uint64_t(0);
+        next++;
+      }
+    }
+    lanes.stones = _mm256_set_epi64x(stones[3], stones[2], stones[1], stones[0]);
+    lanes.mask = _mm256_set_epi64x(mask[3], mask[2], mask[1], mask[0]);
+    lanes.moves = _mm256_set_epi64x(moves[3], moves[2], moves[1], moves[0]);
+    lanes.status = _mm256_set_epi64x(status[3], status[2], status[1], status[0]);
+    lanes.live = _mm256_set_epi64x(live[3], live[2], live[1], live[0]);
+  }
+
+  // One random move on every live lane.
+  __attribute__((target("avx2"), always_inline))
+  static inline void Step(Lanes& lanes) {
+    const __m256i bottom = _mm256_set1_epi64x(kBottomMask);
+    const __m256i board_mask = _mm256_set1_epi64x(kBoardMask);
+    const __m256i column = _mm256_set1_epi64x(0x3F);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i num_cols = _mm256_set1_epi64x(CONNECT_FOUR_NUM_COLS);
+    const __m256i full = _mm256_set1_epi64x(kCells);
+    const __m256i x_wins = _mm256_set1_epi64x(uint8_t(ConnectFourStatus::X_WINS));
+    const __m256i o_wins = _mm256_set1_epi64x(uint8_t(ConnectFourStatus::O_WINS));
+    const __m256i draw = _mm256_set1_epi64x(uint8_t(ConnectFourStatus::DRAW));
+
+    __m256i live = lanes.live;
+    __m256i possible = _mm256_and_si256(_mm256_add_epi64(lanes.mask, bottom), board_mask);
+
+    // Draw a column per lane until every live lane has a legal one.
+    __m256i move = _mm256_setzero_si256();
+    __m256i need = live;
+    do {
+      // xoshiro256** step on all four lanes; x * 5 and x * 9 are done with
+      // shifts because AVX2 has no 64-bit multiply.
+      __m256i x = _mm256_add_epi64(_mm256_slli_epi64(lanes.s1, 2), lanes.s1);
+      x = Rotl<7>(x);
+      __m256i random = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+      __m256i t = _mm256_slli_epi64(lanes.s1, 17);
+      lanes.s2 = _mm256_xor_si256(lanes.s2, lanes.s0);
+      lanes.s3 = _mm256_xor_si256(lanes.s3, lanes.s1);
+      lanes.s1 = _mm256_xor_si256(lanes.s1, lanes.s2);
+      lanes.s0 = _mm256_xor_si256(lanes.s0, lanes.s3);
+      lanes.s2 = _mm256_xor_si256(lanes.s2, t);
+      lanes.s3 = Rotl<45>(lanes.s3);
+
+      // Two columns in [0, 7), from the high and the low 32 bits by
+      // multiply-shift; the second is used when the first is full, which
+      // keeps the loop from repeating in all but a few positions.
+      for(__m256i half : {_mm256_srli_epi64(random, 32), random}) {
+        __m256i col = _mm256_srli_epi64(_mm256_mul_epu32(half, num_cols), 32);
+        __m256i shift = _mm256_sub_epi64(_mm256_slli_epi64(col, 3), col);
+        __m256i candidate = _mm256_and_si256(possible, _mm256_sllv_epi64(column, shift));
+        __m256i take = _mm256_and_si256(need, NonZero(candidate));
+        move = _mm256_or_si256(move, _mm256_and_si256(candidate, take));
+        need = _mm256_andnot_si256(take, need);
+      }
+    } while(!_mm256_testz_si256(need, need));
+
+    __m256i mover = _mm256_or_si256(lanes.stones, move);
+    lanes.mask = _mm256_or_si256(lanes.mask, move);
+    __m256i lines = _mm256_or_si256(
+      _mm256_or_si256(LineMask<1>(mover), LineMask<kStride>(mover)),
+      _mm256_or_si256(LineMask<kStride - 1>(mover), LineMask<kStride + 1>(mover)));
+    __m256i won = _mm256_and_si256(live, NonZero(lines));
+    __m256i x_moved = _mm256_cmpeq_epi64(_mm256_and_si256(lanes.moves, one), _mm256_setzero_si256());
+    lanes.moves = _mm256_add_epi64(lanes.moves, _mm256_and_si256(live, one));
+    __m256i drawn = _mm256_andnot_si256(won, _mm256_and_si256(live, _mm256_cmpeq_epi64(lanes.moves, full)));
+
+    __m256i winner = _mm256_blendv_epi8(o_wins, x_wins, x_moved);
+    lanes.status = _mm256_blendv_epi8(lanes.status, winner, won);
+    lanes.status = _mm256_blendv_epi8(lanes.status, draw, drawn);
+    lanes.stones = _mm256_blendv_epi8(lanes.stones, _mm256_xor_si256(lanes.mask, mover), live);
+    lanes.live = _mm256_andnot_si256(_mm256_or_si256(won, drawn), live);
+  }
+
+  // Plays all boards with kGroups groups of four lanes in flight, so that
+  // their dependency chains overlap. A lane whose game ends is refilled with
+  // the next board instead of idling until its neighbours finish.
+  __attribute__((target("avx2")))
+  void PlayoutsAvx2(Xoshiro256& rng) {
+    Lanes groups[kGroups];
+    size_t next = 0;
+    for(Lanes& lanes : groups) {
+      alignas(32) uint64_t seeds[4][4];
+      for(auto& word : seeds) {
+        for(uint64_t& lane : word) {
+          lane = rng();
+        }
+      }
+      lanes.s0 = _mm256_load_si256(reinterpret_cast<__m256i const*>(seeds[0]));
+      lanes.s1 = _mm256_load_si256(reinterpret_cast<__m256i const*>(seeds[1]));
+      lanes.s2 = _mm256_load_si256(reinterpret_cast<__m256i const*>(seeds[2]));
+      lanes.s3 = _mm256_load_si256(reinterpret_cast<__m256i const*>(seeds[3]));
+      lanes.live = _mm256_setzero_si256();
+      lanes.stones = lanes.mask = lanes.moves = lanes.status = _mm256_setzero_si256();
+      for(int64_t& board : lanes.board) {
+        board = -1;
+      }
+      lanes.occupied = 0;
+      Refill(lanes, next, size());
+    }
+
+    for(;;) {
+      int occupied = 0;
+      for(Lanes& lanes : groups) {
+        Step(lanes);
+      }
+      for(Lanes& lanes : groups) {
+        if(_mm256_movemask_pd(_mm256_castsi256_pd(lanes.live)) != lanes.occupied) {
+          Refill(lanes, next, size());
+        }
+        occupied |= lanes.occupied;
+      }
+      if(!occupied) {
+        break;
+      }
+    }
+  }
+#endif
+
+  std::vector<uint64_t> stones_;
+  std::vector<uint64_t> mask_;
+  std::vector<uint8_t> moves_;
+  std::vector<uint8_t> status_;
+};
+
+// Sum of the scores of count random playouts from state, each +1 for a win
+// and -1 for a loss of the player who made the last move in state. Used by
+// MonteCarloTreeSearchAgent for leaf evaluation.
+inline int RandomPlayoutScore(ConnectFour const& state, int count, Xoshiro256& rng) {
+  thread_local ConnectFourBatch batch;
+  batch.Assign(state, count);
+  batch.RandomPlayouts(rng);
+  size_t x_wins, o_wins, draws;
+  batch.CountResults(x_wins, o_wins, draws);
+  int score = int(x_wins) - int(o_wins);
+  return state.FirstPlayersTurn() ? -score : score;
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Open-addressing hash map for integer keys such as Game::GetStateKey().
+// Keys and values sit together in one flat array and collisions are
+// resolved by linear probing, so a lookup usually touches a single cache
+// line and operator[] finds or inserts with one probe sequence. The table
+// doubles when it is three quarters full. The all-ones key is reserved to
+// mark empty slots and must not be inserted.
+//
+// The interface follows std::unordered_map where it is used in this code:
+// operator[], find, count, iteration over entries with first and second.
+// Inserting may move entries and invalidates iterators and references.
+template <class Key, class Value>
+class FlatHashMap {
+  static_assert(std::is_integral<Key>::value, "FlatHashMap keys must be integers");
+
+public:
+  static constexpr Key kEmptyKey = ~Key(0);
+
+  struct value_type {
+    Key first;
+    Value second;
+  };
+
+  template <class Slot>
+  class Iterator {
+  public:
+    Iterator(Slot* slot, Slot* end) : slot_(slot), end_(end) {
+      SkipEmpty();
+    }
+
+    Slot& operator*() const { return *slot_; }
+    Slot* operator->() const { return slot_; }
+
+    Iterator& operator++() {
+      ++slot_;
+      SkipEmpty();
+      return *this;
+    }
+
+    bool operator==(Iterator const& other) const { return slot_ == other.slot_; }
+    bool operator!=(Iterator const& other) const { return slot_ != other.slot_; }
+
+  private:
+    void SkipEmpty() {
+      while(slot_ != end_ && slot_->first == kEmptyKey) {
+        ++slot_;
+      }
+    }
+
+    Slot* slot_;
+    Slot* end_;
+  };
+
+  using iterator = Iterator<value_type>;
+  using const_iterator = Iterator<value_type const>;
+
+  FlatHashMap() {
+    Rehash(kMinSlots);
+  }
+
+  Value& operator[](Key key) {
+    if(4 * (size_ + 1) > 3 * slots_.size()) {
+      Rehash(2 * slots_.size());
+    }
+    size_t i = Index(key);
+    while(slots_[i].first != key) {
+      if(slots_[i].first == kEmptyKey) {
+        slots_[i].first = key;
+        slots_[i].second = Value();
+        size_++;
+        break;
+      }
+      i = (i + 1) & mask_;
+    }
+    return slots_[i].second;
+  }
+
+  iterator find(Key key) {
+    size_t i = Find(key);
+    return i == kNotFound ? end() : iterator(&slots_[i], slots_.data() + slots_.size());
+  }
+
+  const_iterator find(Key key) const {
+    size_t i = Find(key);
+    return i == kNotFound ? end() : const_iterator(&slots_[i], slots_.data() + slots_.size());
+  }
+
+  size_t count(Key key) const {
+    return Find(key) != kNotFound;
+  }
+
+  // Starts loading the slot where a lookup of key begins, so that a batch
+  // of lookups can overlap their cache misses.
+  void Prefetch(Key key) const {
+    __builtin_prefetch(&slots_[Index(key)]);
+  }
+
+  // Makes room for num_entries without further rehashing.
+  void reserve(size_t num_entries) {
+    size_t num_slots = slots_.size();
+    while(3 * num_slots < 4 * num_entries) {
+      num_slots *= 2;
+    }
+    if(num_slots != slots_.size()) {
+      Rehash(num_slots);
+    }
+  }
+
+  // Keeps the slot array, so a table refilled to a similar size does not
+  // rehash again. Iteration still walks every slot; call shrink_to_fit()
+  // to release the memory.
+  void clear() {
+    std::fill(slots_.begin(), slots_.end(), value_type{kEmptyKey, Value()});
+    size_ = 0;
+  }
+
+  // Rehashes into the fewest slots that hold the current entries.
+  void shrink_to_fit() {
+    size_t num_slots = kMinSlots;
+    while(3 * num_slots < 4 * size_) {
+      num_slots *= 2;
+    }
+    if(num_slots != slots_.size()) {
+      Rehash(num_slots);
+    }
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t BytesUsed() const {
+    return slots_.size() * sizeof(value_type);
+  }
+
+  iterator begin() { return iterator(slots_.data(), slots_.data() + slots_.size()); }
+  iterator end() { return iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size()); }
+  const_iterator begin() const { return const_iterator(slots_.data(), slots_.data() + slots_.size()); }
+  const_iterator end() const { return const_iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size()); }
+
+private:
+  static const size_t kMinSlots = 16;
+  static const size_t kNotFound = ~size_t(0);
+
+  static int Log2(size_t n) {
+    int log = 0;
+    while((size_t(1) << log) < n) {
+      log++;
+    }
+    return log;
+  }
+
+  // Fibonacci hashing: the high bits of the product depend on every bit of
+  // the key.
+  size_t Index(Key key) const {
+    return size_t((uint64_t(key) * 0x9E3779B97F4A7C15ull) >> shift_);
+  }
+
+  size_t Find(Key key) const {
+    for(size_t i = Index(key); ; i = (i + 1) & mask_) {
+      if(slots_[i].first == key) {
+        return i;
+      }
+      if(slots_[i].first == kEmptyKey) {
+        return kNotFound;
+      }
+    }
+  }
+
+  void Rehash(size_t num_slots) {
+    std::vector<value_type> old(num_slots, value_type{kEmptyKey, Value()});
+    old.swap(slots_);
+    mask_ = num_slots - 1;
+    shift_ = 64 - Log2(num_slots);
+    for(value_type const& slot : old) {
+      if(slot.first != kEmptyKey) {
+        size_t i = Index(slot.first);
+        while(slots_[i].first != kEmptyKey) {
+          i = (i + 1) & mask_;
+        }
+        slots_[i] = slot;
+      }
+    }
+  }
+
+  std::vector<value_type> slots_;
+  size_t mask_ = 0;
+  int shift_ = 64;
+  size_t size_ = 0;
+};
@@ -2,7 +2,7 @@
 #include <vector>
 #include <unordered_map>
 
-template <class Game, template <class Game> class Agent1, template <class Game> class Agent2>
+template <class Game, template <class> class Agent1, template <class> class Agent2>
 class GameSession {
 public:
     GameSession(Game &game, Agent1<Game>& agent1, Agent2<Game> &agent2)
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// Fixed-size histogram of non-negative integers such as durations in
+// nanoseconds. Values below 8 are counted exactly; larger values fall into
+// eight buckets per power of two, so quantiles are within 12.5% whatever
+// the range, and recording never allocates.
+class LogHistogram {
+public:
+  void Record(uint64_t value) {
+    counts_[Bucket(value)]++;
+    count_++;
+    sum_ += value;
+    max_ = std::max(max_, value);
+  }
+
+  void Merge(LogHistogram const& other) {
+    for(int i = 0; i < kNumBuckets; i++) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  // Lower bound of the bucket holding the q-th quantile, q in [0, 1].
+  uint64_t Quantile(double q) const {
+    if(count_ == 0) {
+      return 0;
+    }
+    uint64_t rank = std::min<uint64_t>(q * count_, count_ - 1);
+    uint64_t seen = 0;
+    for(int i = 0; i < kNumBuckets; i++) {
+      seen += counts_[i];
+      if(seen > rank) {
+        return LowerBound(i);
+      }
+    }
+    return max_;
+  }
+
+  double Mean() const {
+    return count_ ? double(sum_) / count_ : 0;
+  }
+
+  uint64_t Max() const {
+    return max_;
+  }
+
+  uint64_t Count() const {
+    return count_;
+  }
+
+private:
+  static const int kNumBuckets = 8 * 62;
+
+  static int Bucket(uint64_t value) {
+    if(value < 8) {
+      return value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    return 8 * (exponent - 2) + ((value >> (exponent - 3)) & 7);
+  }
+
+  static uint64_t LowerBound(int bucket) {
+    if(bucket < 8) {
+      return bucket;
+    }
+    int exponent = bucket / 8 + 2;
+    return uint64_t(8 + bucket % 8) << (exponent - 3);
+  }
+
+  uint64_t counts_[kNumBuckets] = {};
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t max_ = 0;
+};
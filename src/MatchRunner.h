@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Histogram.h"
+#include "Parallel.h"
+#include "Random.h"
+
+// Aggregate outcome of a match. Player 1 always moves first.
+struct MatchResults {
+  uint64_t games = 0;
+  uint64_t player1_wins = 0;
+  uint64_t player2_wins = 0;
+  uint64_t draws = 0;
+  uint64_t moves = 0;
+  double elapsed_ms = 0;
+  // Time spent in TakeAction by each player, in nanoseconds.
+  LogHistogram move_nanos[2];
+
+  void Merge(MatchResults const& other) {
+    games += other.games;
+    player1_wins += other.player1_wins;
+    player2_wins += other.player2_wins;
+    draws += other.draws;
+    moves += other.moves;
+    move_nanos[0].Merge(other.move_nanos[0]);
+    move_nanos[1].Merge(other.move_nanos[1]);
+  }
+
+  double Player1WinRate() const { return games ? double(player1_wins) / games : 0; }
+  double Player2WinRate() const { return games ? double(player2_wins) / games : 0; }
+  double DrawRate() const { return games ? double(draws) / games : 0; }
+
+  double GamesPerSecond() const {
+    return elapsed_ms > 0 ? games / elapsed_ms * 1000 : 0;
+  }
+};
+
+template <class Agent, class = void>
+struct HasSetSeed : std::false_type { };
+
+template <class Agent>
+struct HasSetSeed<Agent, decltype(std::declval<Agent&>().SetSeed(uint64_t()), void())>
+  : std::true_type { };
+
+// Plays many games between two agents on several threads. Every worker
+// plays on its own copies of the agents, taking games from a shared
+// counter, and keeps only running totals, so memory does not grow with the
+// number of games.
+//
+// Game i is played after seeding the worker's ThreadRng and any agent with
+// SetSeed(uint64_t) from the match seed and i, and after Reset() on both
+// agents. Results therefore do not depend on the thread count or on which
+// worker plays which game, as long as the agents do not learn during the
+// match.
+template <class Game, template <class> class Agent1, template <class> class Agent2>
+class MatchRunner {
+public:
+  MatchRunner(Agent1<Game> const& agent1, Agent2<Game> const& agent2)
+    : player1(agent1), player2(agent2) { }
+
+  void SetThreadCount(size_t num_threads) {
+    threads = std::max<size_t>(num_threads, 1);
+  }
+
+  void SetSeed(uint64_t seed) {
+    base_seed = seed;
+  }
+
+  MatchResults Play(uint64_t num_games) {
+    using Clock = std::chrono::steady_clock;
+    std::atomic<uint64_t> next_game(0);
+    std::mutex results_lock;
+    MatchResults results;
+
+    auto start = Clock::now();
+    ParallelFor(threads, [&](size_t) {
+      Agent1<Game> agent1(player1);
+      Agent2<Game> agent2(player2);
+      MatchResults local;
+      for(uint64_t index = next_game++; index < num_games; index = next_game++) {
+        uint64_t seed = GameSeed(index);
+        SeedThreadRng(seed);
+        agent1.Reset();
+        agent2.Reset();
+        if constexpr(HasSetSeed<Agent1<Game>>::value) {
+          agent1.SetSeed(seed);
+        }
+        if constexpr(HasSetSeed<Agent2<Game>>::value) {
+          agent2.SetSeed(seed + 1);
+        }
+
+        Game game;
+        while(!game.GameOver()) {
+          bool first = game.FirstPlayersTurn();
+          auto move_start = Clock::now();
+          if(first) {
+            agent1.TakeAction(game);
+          } else {
+            agent2.TakeAction(game);
+          }
+          local.move_nanos[first ? 0 : 1].Record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - move_start).count());
+          local.moves++;
+        }
+
+        local.games++;
+        if(game.Draw()) {
+          local.draws++;
+        } else if(game.GetReward() > 0) {
+          local.player1_wins++;
+        } else {
+          local.player2_wins++;
+        }
+      }
+      std::lock_guard<std::mutex> lock(results_lock);
+      results.Merge(local);
+    });
+    results.elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return results;
+  }
+
+private:
+  uint64_t GameSeed(uint64_t index) const {
+    uint64_t state = base_seed ^ (index * 0xD1B54A32D192ED03ull);
+    return SplitMix64(state);
+  }
+
+  Agent1<Game> player1;
+  Agent2<Game> player2;
+  size_t threads = 1;
+  uint64_t base_seed = 1;
+};
@@ -1,56 +1,81 @@
 #pragma once
 
-#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "FlatHashMap.h"
+#include "Parallel.h"
+#include "Random.h"
+#include "SearchReport.h"
+#include "SolvedDatabase.h"
+#include "TranspositionTable.h"
 
+// Solves the game exactly by default. With SetAlphaBeta(true) it instead
+// runs an iterative-deepening negamax alpha-beta search that is bounded by
+// a depth and/or time budget and scores the horizon with a pluggable static
+// evaluation, which makes it usable on games too large to solve.
+// SetThreadCount(n) runs that search Lazy-SMP style: n threads deepen from
+// the root concurrently with slightly different move orders and share their
+// results only through the transposition table.
 template <class Game>
 class MinimaxAgent {
-public: 
+public:
+  // Scores are from the point of view of the side to move. A win found n
+  // plies from the root scores kWinScore - n so that faster wins are
+  // preferred; evaluations must stay well inside +/- kWinThreshold.
+  static const int kWinScore = 10000;
+  static const int kWinThreshold = kWinScore - 1000;
+  static const int kMaxDepth = 250;
+
+  MinimaxAgent()
+    : alpha_beta(false), depth_limit(kMaxDepth), time_limit_ms(0),
+      evaluation([](const Game&) { return 0; }), table(0), threads(1) { }
 
   void TakeAction(Game& state) {
     state.ApplyAction(GetAction(state));
   }
 
   typename Game::Action GetAction(const Game& state) {
-    if(minimax_tree.find(state.GetStateString()) == minimax_tree.end()) {
-      MiniMax(state, true);
-    }
-
-    typename Game::Action best_action;
-    double best_score = -10;
-    for(auto const& action : state.GetAvailableActions()) {      
-      Game result_of_action = state.ForwardModel(action);
-      std::string state_string = result_of_action.GetStateString();
-      double score = minimax_tree[state_string]; 
-      if(score >= best_score) {
-        best_score = score;
-        best_action = action;
-      }
+    auto start = Clock::now();
+    report = SearchReport();
+    report.agent = "minimax";
+    typename Game::Action action = alpha_beta ? IterativeDeepening(state) : SolvedAction(state);
+    report.elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    report.bytes_used = table.BytesUsed() + minimax_tree.BytesUsed();
+    if(search_log) {
+      search_log->Write(report);
     }
-    return best_action;
+    return action;
   }
 
-  void Experience(const std::string &state, 
-                  const typename Game::Action& action, 
-                  float reward, 
-                  const std::string &next_state,
+  void Experience(uint64_t state,
+                  const typename Game::Action& action,
+                  float reward,
+                  uint64_t next_state,
                   bool terminal) {
   }
 
 
   double MiniMax(const Game& state, bool maximizing_player) {
-   std::string state_string = state.GetStateString();
+   uint64_t state_key = Key(state);
    if(state.GameOver()) {
       if(state.Draw()) {
-        minimax_tree[state_string] = 0;
+        minimax_tree[state_key] = 0;
         return 0;
       }
       if(!maximizing_player) {
-        minimax_tree[state_string] = 1;
+        minimax_tree[state_key] = 1;
         return 1;
       } else {
-        minimax_tree[state_string] = -1;
+        minimax_tree[state_key] = -1;
         return -1;
-      } 
+      }
     }
 
     if(maximizing_player) {
@@ -59,7 +84,7 @@ public:
         Game result_of_action = state.ForwardModel(action);
         best_value = std::max(best_value, MiniMax(result_of_action, false));
       }
-      minimax_tree[state_string] = best_value;
+      minimax_tree[state_key] = best_value;
       return best_value;
     } else {
       double best_value = 10;
@@ -67,11 +92,414 @@ public:
         Game result_of_action = state.ForwardModel(action);
         best_value = std::min(best_value, MiniMax(result_of_action, true));
       }
-      minimax_tree[state_string] = best_value;
+      minimax_tree[state_key] = best_value;
       return best_value;
     }
   }
 
-    std::unordered_map<std::string, double> minimax_tree;
+    FlatHashMap<uint64_t, double> minimax_tree;
     void Reset() { }
-};
\ No newline at end of file
+
+  // Solves every position reachable from state that is not already in the
+  // loaded database or in minimax_tree.
+  void Solve(const Game& state) {
+    double value;
+    if(!FindSolved(Key(state), value)) {
+      MiniMax(state, state.FirstPlayersTurn());
+    }
+  }
+
+  // Writes minimax_tree to path as a SolvedDatabase.
+  bool SaveSolvedDatabase(std::string const& path) const {
+    return SolvedDatabase::Write(path, minimax_tree,
+                                 use_symmetry ? SolvedDatabase::kCanonicalKeys : 0,
+                                 SolvedDatabase::GameTag<Game>());
+  }
+
+  // Maps a database written by SaveSolvedDatabase, possibly by another
+  // process, and consults it before minimax_tree. Copies of the agent share
+  // the mapping. Also adopts the database's choice of symmetric keys.
+  // Returns false for a database of another game.
+  bool LoadSolvedDatabase(std::string const& path) {
+    auto loaded = std::make_shared<SolvedDatabase>();
+    if(!loaded->Open(path, SolvedDatabase::GameTag<Game>())) {
+      return false;
+    }
+    SetUseSymmetry(loaded->flags() & SolvedDatabase::kCanonicalKeys);
+    database = loaded;
+    return true;
+  }
+
+  // Keys minimax_tree by Game::GetCanonicalKey(), so symmetric positions are
+  // solved and stored once. The alpha-beta transposition table always uses
+  // raw keys because its best moves are indices into the raw action order.
+  void SetUseSymmetry(bool enabled) {
+    if(enabled != use_symmetry) {
+      minimax_tree.clear();
+    }
+    use_symmetry = enabled;
+  }
+
+  void SetAlphaBeta(bool enabled) {
+    alpha_beta = enabled;
+    if(alpha_beta && table.size() <= 1) {
+      table.Resize(1 << 20);
+    }
+  }
+
+  // Maximum iterative-deepening depth in plies.
+  void SetDepthLimit(int depth) {
+    depth_limit = std::min(std::max(depth, 1), int(kMaxDepth));
+  }
+
+  // Wall-clock budget per move; zero or less means no limit. The move of
+  // the deepest completed iteration is played.
+  void SetTimeLimit(double ms) {
+    time_limit_ms = ms;
+  }
+
+  // Static evaluation used at the search horizon, from the point of view of
+  // the side to move.
+  void SetEvaluation(std::function<int(const Game&)> eval) {
+    evaluation = eval;
+  }
+
+  void SetTranspositionTableSize(size_t num_entries) {
+    table.Resize(num_entries);
+  }
+
+  // Number of threads used by the alpha-beta search.
+  void SetThreadCount(size_t num_threads) {
+    threads.resize(std::max<size_t>(num_threads, 1));
+  }
+
+  // Depth of the last completed iteration and its root score.
+  int CompletedDepth() const {
+    return completed_depth;
+  }
+
+  int RootScore() const {
+    return root_score;
+  }
+
+  // Nodes visited by all threads during the last search.
+  uint64_t NodesSearched() const {
+    uint64_t nodes = 0;
+    for(SearchThread const& thread : threads) {
+      nodes += thread.nodes_searched;
+    }
+    return nodes;
+  }
+
+  // Statistics of the search behind the last GetAction. Without alpha-beta
+  // nodes_searched counts the positions newly solved.
+  SearchReport const& LastSearchReport() const {
+    return report;
+  }
+
+  // Writes the report of every move to log as a JSON line. Pass nullptr to
+  // stop.
+  void SetSearchLog(SearchLog* log) {
+    search_log = log;
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+  using Actions = typename Game::Actions;
+
+  uint64_t Key(const Game& state) const {
+    return use_symmetry ? state.GetCanonicalKey() : state.GetStateKey();
+  }
+
+  bool FindSolved(uint64_t key, double& value) const {
+    if(database && database->Find(key, value)) {
+      return true;
+    }
+    auto it = minimax_tree.find(key);
+    if(it == minimax_tree.end()) {
+      return false;
+    }
+    value = it->second;
+    return true;
+  }
+
+  double SolvedValue(const Game& state) {
+    double value;
+    if(FindSolved(Key(state), value)) {
+      return value;
+    }
+    return MiniMax(state, state.FirstPlayersTurn());
+  }
+
+  typename Game::Action SolvedAction(const Game& state) {
+    size_t known = minimax_tree.size();
+    Solve(state);
+
+    // minimax_tree holds scores from the first player's point of view.
+    double sign = state.FirstPlayersTurn() ? 1 : -1;
+    typename Game::Action best_action;
+    double best_score = -10;
+    for(auto const& action : state.GetAvailableActions()) {
+      Game result_of_action = state.ForwardModel(action);
+      double score = sign * SolvedValue(result_of_action);
+      if(score >= best_score) {
+        best_score = score;
+        best_action = action;
+      }
+    }
+    report.nodes_searched = minimax_tree.size() - known;
+    report.tree_nodes = minimax_tree.size();
+    report.score = best_score;
+    report.principal_variation.push_back(ActionString(best_action));
+    return best_action;
+  }
+
+  struct SearchThread {
+    size_t id = 0;
+    Xoshiro256 rng;
+    uint64_t nodes_searched = 0;
+    uint64_t ply_sum = 0;
+    int max_ply = 0;
+    uint64_t table_probes = 0;
+    uint64_t table_hits = 0;
+    bool aborted = false;
+    bool reached_horizon = false;
+    int completed_depth = 0;
+    int root_score = 0;
+    int best_move = 0;
+  };
+
+  typename Game::Action IterativeDeepening(const Game& state) {
+    // A finished game has no moves to order or search. Like SolvedAction,
+    // return a default action.
+    if(state.GameOver()) {
+      return typename Game::Action();
+    }
+    table.NewSearch();
+    stop = false;
+    timed = time_limit_ms > 0;
+    if(timed) {
+      deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                   std::chrono::duration<double, std::milli>(time_limit_ms));
+    }
+
+    ParallelFor(threads.size(), [&](size_t id) {
+      SearchThread& thread = threads[id];
+      thread.id = id;
+      thread.rng.Seed(id);
+      Deepen(state, thread);
+      // The first thread to finish ends the search for everyone.
+      stop = true;
+    });
+
+    // Play the move of the deepest completed iteration.
+    SearchThread const* best = &threads[0];
+    for(SearchThread const& thread : threads) {
+      if(thread.completed_depth > best->completed_depth) {
+        best = &thread;
+      }
+    }
+    completed_depth = best->completed_depth;
+    root_score = best->root_score;
+    typename Game::Action action = state.GetAvailableActions()[best->best_move];
+
+    report.completed_depth = completed_depth;
+    report.score = root_score;
+    report.tree_nodes = table.size();
+    uint64_t ply_sum = 0;
+    for(SearchThread const& thread : threads) {
+      report.nodes_searched += thread.nodes_searched;
+      ply_sum += thread.ply_sum;
+      report.max_depth = std::max(report.max_depth, thread.max_ply);
+      report.table_lookups += thread.table_probes;
+      report.table_hits += thread.table_hits;
+    }
+    report.average_depth = report.nodes_searched ? double(ply_sum) / report.nodes_searched : 0;
+
+    // The rest of the line comes from the best moves in the table.
+    Game position = state.ForwardModel(action);
+    report.principal_variation.push_back(ActionString(action));
+    TTEntry entry;
+    while(int(report.principal_variation.size()) < completed_depth && !position.GameOver() &&
+          table.Probe(position.GetStateKey(), entry)) {
+      Actions actions = position.GetAvailableActions();
+      if(entry.best_move >= int(actions.size())) {
+        break;
+      }
+      report.principal_variation.push_back(ActionString(actions[entry.best_move]));
+      position.ApplyAction(actions[entry.best_move]);
+    }
+    return action;
+  }
+
+  // state is not terminal, so the root has at least one move.
+  void Deepen(const Game& state, SearchThread& thread) {
+    Actions actions = state.GetAvailableActions();
+    uint8_t order[Actions::capacity()];
+    OrderMoves(state, actions, -1, order, thread);
+    thread.nodes_searched = 0;
+    thread.ply_sum = 0;
+    thread.max_ply = 0;
+    thread.table_probes = 0;
+    thread.table_hits = 0;
+    thread.aborted = false;
+    thread.completed_depth = 0;
+    thread.root_score = 0;
+    thread.best_move = order[0];
+
+    // Odd helpers start one ply deeper so the threads spread over two
+    // depths instead of all repeating the same iteration.
+    int first_depth = std::min(1 + int(thread.id % 2), depth_limit);
+    for(int depth = first_depth; depth <= depth_limit; depth++) {
+      thread.reached_horizon = false;
+      int score = NegaMax(state, depth, 0, -kWinScore, kWinScore, thread);
+      if(thread.aborted) {
+        break;
+      }
+      TTEntry entry;
+      if(table.Probe(state.GetStateKey(), entry) && entry.best_move < int(actions.size())) {
+        thread.best_move = entry.best_move;
+      }
+      thread.completed_depth = depth;
+      thread.root_score = score;
+      // Stop once the result no longer depends on the horizon.
+      if(!thread.reached_horizon || std::abs(score) >= kWinThreshold) {
+        break;
+      }
+    }
+  }
+
+  // Writes the indices of actions in search order: the hash move first, then
+  // by descending Game::MovePriority (centre first). The main thread keeps
+  // generation order among equals; helpers break ties randomly.
+  void OrderMoves(const Game& state, Actions const& actions, int hash_move,
+                  uint8_t* order, SearchThread& thread) const {
+    int priority[Actions::capacity()];
+    for(uint32_t i = 0; i < actions.size(); i++) {
+      order[i] = i;
+      priority[i] = 2 * state.MovePriority(actions[i]);
+      if(thread.id != 0) {
+        priority[i] += thread.rng.Below(2);
+      }
+    }
+    std::stable_sort(order, order + actions.size(), [&](uint8_t a, uint8_t b) {
+      return priority[a] > priority[b];
+    });
+    if(hash_move >= 0 && hash_move < int(actions.size())) {
+      uint8_t* position = std::find(order, order + actions.size(), hash_move);
+      std::rotate(order, position, position + 1);
+    }
+  }
+
+  // Mate scores are stored relative to the node so that they stay valid
+  // when the position is reached at a different ply.
+  static int ToTable(int score, int ply) {
+    if(score >= kWinThreshold) return score + ply;
+    if(score <= -kWinThreshold) return score - ply;
+    return score;
+  }
+
+  static int FromTable(int score, int ply) {
+    if(score >= kWinThreshold) return score - ply;
+    if(score <= -kWinThreshold) return score + ply;
+    return score;
+  }
+
+  bool TimeUp(SearchThread& thread) {
+    if((thread.nodes_searched & 1023) == 0 &&
+       (stop.load(std::memory_order_relaxed) || (timed && Clock::now() >= deadline))) {
+      thread.aborted = true;
+    }
+    return thread.aborted;
+  }
+
+  int NegaMax(const Game& state, int depth, int ply, int alpha, int beta, SearchThread& thread) {
+    thread.nodes_searched++;
+    thread.ply_sum += ply;
+    thread.max_ply = std::max(thread.max_ply, ply);
+    if(state.GameOver()) {
+      // The side to move did not make the last move, so it cannot have won.
+      return state.Draw() ? 0 : -(kWinScore - ply);
+    }
+    if(depth == 0) {
+      thread.reached_horizon = true;
+      return evaluation(state);
+    }
+    if(TimeUp(thread)) {
+      return 0;
+    }
+
+    uint64_t key = state.GetStateKey();
+    int original_alpha = alpha;
+    int hash_move = -1;
+    TTEntry entry;
+    thread.table_probes++;
+    if(table.Probe(key, entry)) {
+      thread.table_hits++;
+      hash_move = entry.best_move;
+      if(entry.depth >= depth) {
+        int score = FromTable(entry.score, ply);
+        if(entry.bound == Bound::EXACT ||
+           (entry.bound == Bound::LOWER && score >= beta) ||
+           (entry.bound == Bound::UPPER && score <= alpha)) {
+          thread.reached_horizon = thread.reached_horizon || entry.horizon;
+          return score;
+        }
+      }
+    }
+
+    bool outer_horizon = thread.reached_horizon;
+    thread.reached_horizon = false;
+
+    Actions actions = state.GetAvailableActions();
+    uint8_t order[Actions::capacity()];
+    OrderMoves(state, actions, hash_move, order, thread);
+
+    int best_score = -kWinScore - 1;
+    int best_move = order[0];
+    for(uint32_t k = 0; k < actions.size(); k++) {
+      Game result_of_action = state.ForwardModel(actions[order[k]]);
+      int score = -NegaMax(result_of_action, depth - 1, ply + 1, -beta, -alpha, thread);
+      if(thread.aborted) {
+        return 0;
+      }
+      if(score > best_score) {
+        best_score = score;
+        best_move = order[k];
+      }
+      alpha = std::max(alpha, score);
+      if(alpha >= beta) {
+        break;
+      }
+    }
+
+    TTEntry result;
+    result.score = ToTable(best_score, ply);
+    result.depth = depth;
+    result.bound = best_score <= original_alpha ? Bound::UPPER
+                 : best_score >= beta ? Bound::LOWER
+                 : Bound::EXACT;
+    result.best_move = best_move;
+    result.horizon = thread.reached_horizon;
+    table.Store(key, result);
+
+    thread.reached_horizon = outer_horizon || thread.reached_horizon;
+    return best_score;
+  }
+
+  bool alpha_beta;
+  bool use_symmetry = false;
+  std::shared_ptr<const SolvedDatabase> database;
+  int depth_limit;
+  double time_limit_ms;
+  std::function<int(const Game&)> evaluation;
+  TranspositionTable table;
+  std::vector<SearchThread> threads;
+  CopyableAtomic<bool> stop;
+  bool timed = false;
+  Clock::time_point deadline;
+  int completed_depth = 0;
+  int root_score = 0;
+  SearchReport report;
+  SearchLog* search_log = nullptr;
+};
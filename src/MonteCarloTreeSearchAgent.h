@@ -1,217 +1,1074 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
 #include <vector>
-#include <unordered_map>
-#include <memory>
+#include "FlatHashMap.h"
+#include "NodeArena.h"
+#include "Parallel.h"
+#include "Random.h"
+#include "SearchReport.h"
 #include "utils.h"
-#include "Stopwatch.h"
 
+// Virtual losses are pending visits of threads that are still below an edge
+// in a shared tree; they count as lost plays until backed up.
 struct GameStats {
-  int wins;
-  int plays;
+  CopyableAtomic<int> wins;
+  CopyableAtomic<int> plays;
+  CopyableAtomic<int> virtual_loss;
 };
 
+// Edge from a node to the position reached by playing action. Stats are kept
+// from the point of view of the player choosing the action. The child is
+// published last, so a thread that sees it may read the whole child node.
+// Until then it is kNoNode, or kRetryExpansion if an expansion found no room
+// in the tree and left the edge for a later iteration to claim again.
+const uint32_t kRetryExpansion = kNoNode - 1;
+
+template <class Game>
+struct TreeEdge {
+  GameStats stats;
+  CopyableAtomic<uint32_t> child;
+  typename Game::Action action;
+};
+
+// The edges of a node occupy the contiguous range
+// [first_edge, first_edge + num_edges) of the edge arena. The first
+// num_expanded of them have been claimed for expansion, the rest are
+// unexplored. With transpositions enabled a node may be the child of several
+// edges, and visits counts the visits through all of them.
 template <class Game>
 struct TreeNode {
-  using TreeNodePtr = TreeNode<Game>*;
-  
-  TreeNode(Game const& game, 
-           bool our_turn, 
-           TreeNodePtr parent,
-           typename Game::Action action,
-           float exploration_rate)
-    : stats({0, 0}), 
-      state(game), 
-      our_turn(our_turn), 
-      parent(parent), 
-      action(action), 
-      exploration_rate(exploration_rate) { 
-        unexplored_actions = state.GetAvailableActions();
-        std::random_shuffle(unexplored_actions.begin(), unexplored_actions.end());
+  Game state;
+  CopyableAtomic<int> visits;
+  uint32_t first_edge;
+  uint8_t num_edges;
+  CopyableAtomic<uint8_t> num_expanded;
+};
+
+enum class MctsParallelism {
+  ROOT,
+  TREE
+};
+
+// What a tree does once it holds as many nodes as its budget allows. With
+// STOP_EXPANDING the search goes on from the leaves it has, refining their
+// statistics. With PRUNE the least visited subtrees are released to make
+// room for new nodes; their edges keep the statistics gathered so far and
+// are expanded again when selection reaches them.
+enum class MctsMemoryPolicy {
+  STOP_EXPANDING,
+  PRUNE
+};
+
+using SearchClock = std::chrono::steady_clock;
+
+// Per-thread scratch state of a search. Generators are seeded from the
+// creating thread's generator unless the agent is given a seed.
+struct SearchWorker {
+  SearchWorker() : rng(ThreadRng()()) { }
+
+  std::vector<uint32_t> path;
+  Xoshiro256 rng;
+
+  // Statistics of the current search for the SearchReport. The phase times
+  // are only kept while profiling.
+  uint64_t depth_sum = 0;
+  int max_depth = 0;
+  uint64_t table_lookups = 0;
+  uint64_t table_hits = 0;
+  SearchClock::duration phase_time[4] = {};
+
+  void ResetStatistics() {
+    depth_sum = 0;
+    max_depth = 0;
+    table_lookups = 0;
+    table_hits = 0;
+    std::fill(phase_time, phase_time + 4, SearchClock::duration::zero());
+  }
+};
+
+// Sum of the scores of count random playouts from state: +1 when the player
+// who made the last move in state wins, -1 when they lose and 0 for a draw.
+// Games with a faster batched engine provide an overload next to the game,
+// which SearchTree picks up by argument-dependent lookup.
+template <class Game>
+int RandomPlayoutScore(const Game& state, int count, Xoshiro256& rng) {
+  int score = 0;
+  for(int i = 0; i < count; i++) {
+    Game simulated_game = state;
+    bool our_turn = true;
+
+    while(!simulated_game.GameOver()) {
+      auto actions = simulated_game.GetAvailableActions();
+      simulated_game.ApplyAction(*select_randomly(actions.begin(), actions.end(), rng));
+      our_turn = !our_turn;
+    }
+
+    if(!simulated_game.Draw()) {
+      score += our_turn ? 1 : -1;
+    }
+  }
+  return score;
+}
+
+// A search tree that one or more workers grow. Between searches it is only
+// touched by the owning agent's thread. With transpositions enabled it is a
+// DAG in which every position has a single node.
+template <class Game>
+class SearchTree {
+public:
+  using Node = TreeNode<Game>;
+  using Edge = TreeEdge<Game>;
+  static_assert(Game::Actions::capacity() <= std::numeric_limits<uint8_t>::max(),
+                "TreeNode stores edge counts in a byte");
+
+  SearchTree()
+    : exploration_rate(2), rollouts_per_leaf(1), profiling(false), concurrent(false), use_transpositions(false),
+      node_budget(0), memory_policy(MctsMemoryPolicy::PRUNE), pruned_nodes(0), root(kNoNode) { }
+
+  // Continues from the subtree of state when it is reachable from the
+  // current root, otherwise starts a new tree. Returns the number of nodes
+  // carried over, zero for a new tree.
+  size_t SetRoot(const Game& state, bool reuse_tree, SearchWorker& worker) {
+   uint32_t reused_root = reuse_tree ? FindNode(state.GetStateKey()) : kNoNode;
+   if(reused_root != kNoNode) {
+     Reroot(reused_root);
+     return nodes.size();
+   } else {
+     nodes.Clear();
+     edges.Clear();
+     transpositions.clear();
+     concurrent = false;
+     root = NewNode(state, worker);
+     if(use_transpositions) {
+       transpositions[state.GetStateKey()] = root;
+     }
+     return 0;
+   }
+  }
+
+  void Clear() {
+    root = kNoNode;
+    transpositions.clear();
+  }
+
+  Node const& RootNode() const {
+    return nodes[root];
+  }
+
+  Edge const& GetEdge(uint32_t index) const {
+    return edges[index];
+  }
+
+  void SetExplorationRate(float rate) {
+    exploration_rate = rate;
   }
 
-  double WinRatio() const {
-    return stats.wins / (double) stats.plays;
+  void SetRolloutsPerLeaf(int count) {
+    rollouts_per_leaf = count;
   }
 
-  double UpperConfidenceBound() const {
-  double win_percentage = WinRatio();
-    
-    if(!parent) {
-      return win_percentage;
+  void SetProfiling(bool enabled) {
+    profiling = enabled;
+  }
+
+  size_t NumNodes() const {
+    return nodes.size();
+  }
+
+  size_t BytesUsed() const {
+    return nodes.BytesUsed() + edges.BytesUsed() + spare_nodes.BytesUsed() + spare_edges.BytesUsed() +
+           transpositions.BytesUsed();
+  }
+
+  // Upper bound of the memory a node budget accounts for per node: a node
+  // with the most edges any position has, in the arenas and in the spare
+  // arenas that rerooting and pruning copy into, and its transposition
+  // table slots.
+  static size_t BytesPerNode(bool transpositions) {
+    size_t bytes = 2 * (sizeof(Node) + Game::Actions::capacity() * sizeof(Edge));
+    if(transpositions) {
+      bytes += 3 * sizeof(typename FlatHashMap<uint64_t, uint32_t>::value_type);
+    }
+    return bytes;
+  }
+
+  // Limits the tree to max_nodes nodes, or lifts the limit with zero. The
+  // limit is raised to four times the number of actions, so that pruning
+  // can always free half of it. Changing it releases the tree.
+  void SetNodeBudget(size_t max_nodes, MctsMemoryPolicy policy) {
+    memory_policy = policy;
+    if(max_nodes) {
+      max_nodes = std::max<size_t>(max_nodes, 4 * Game::Actions::capacity());
+    }
+    if(max_nodes == node_budget) {
+      return;
+    }
+    node_budget = max_nodes;
+    nodes = NodeArena<Node>();
+    edges = NodeArena<Edge>();
+    spare_nodes = NodeArena<Node>();
+    spare_edges = NodeArena<Edge>();
+    if(node_budget) {
+      size_t max_edges = node_budget * Game::Actions::capacity();
+      nodes.SetMaxGrowth(node_budget);
+      edges.SetMaxGrowth(max_edges);
+      spare_nodes.SetMaxGrowth(node_budget);
+      spare_edges.SetMaxGrowth(max_edges);
+    }
+    Clear();
+  }
+
+  // Nodes released by pruning since the last PrepareSearch.
+  size_t NumPrunedNodes() const {
+    return pruned_nodes;
+  }
+
+  // Actions along the most played edges from the root, starting with the
+  // edge of first_action.
+  void PrincipalVariation(typename Game::Action const& first_action,
+                          std::vector<std::string>& variation) const {
+    variation.clear();
+    uint32_t node_index = root;
+    bool first = true;
+    while(IsNode(node_index)) {
+      Node const& node = nodes[node_index];
+      Edge const* best = nullptr;
+      for(uint32_t i = node.first_edge; i < node.first_edge + node.num_expanded; i++) {
+        Edge const& edge = edges[i];
+        if(first ? edge.action == first_action
+                 : edge.stats.plays > 0 && (!best || edge.stats.plays > best->stats.plays)) {
+          best = &edge;
+        }
+      }
+      if(!best) {
+        if(first) {
+          variation.push_back(ActionString(first_action));
+        }
+        break;
+      }
+      variation.push_back(ActionString(best->action));
+      node_index = best->child.load(std::memory_order_relaxed);
+      first = false;
+    }
+  }
+
+  // Takes effect when the next tree is started.
+  void SetTranspositions(bool enabled) {
+    if(enabled != use_transpositions) {
+      use_transpositions = enabled;
+      Clear();
+    }
+  }
+
+  // Prepares the tree for num_workers threads that will run up to
+  // iterations_per_worker iterations each. With more than one worker the
+  // arenas can no longer grow during the search, so room for the worst case
+  // of one new node per iteration is reserved up front, within the node
+  // budget. Workers of a shared tree cannot prune while they search, so a
+  // pruning tree is cut back to half its budget here instead and stops
+  // expanding when it fills up.
+  void PrepareSearch(size_t num_workers, size_t iterations_per_worker) {
+    concurrent = num_workers > 1;
+    pruned_nodes = 0;
+    if(concurrent) {
+      if(node_budget && memory_policy == MctsMemoryPolicy::PRUNE && nodes.size() > node_budget / 2) {
+        Prune();
+      }
+      size_t new_nodes = num_workers * iterations_per_worker;
+      if(node_budget) {
+        new_nodes = std::min(new_nodes, node_budget - nodes.size());
+      }
+      nodes.Reserve(nodes.size() + new_nodes);
+      edges.Reserve(edges.size() + new_nodes * Game::Actions::capacity());
+    }
+  }
+
+  // Runs iterations until max_iterations are done, the deadline has passed
+  // or stop is raised, whichever comes first. The clock is read before every
+  // iteration. Returns the number of iterations run.
+  size_t Search(size_t max_iterations,
+                SearchClock::time_point deadline,
+                std::atomic<bool> const* stop,
+                SearchWorker& worker) {
+    bool timed = deadline != SearchClock::time_point::max();
+    size_t iterations = 0;
+    while(iterations < max_iterations) {
+      if(timed && SearchClock::now() >= deadline) {
+        break;
+      }
+      if(stop && stop->load(std::memory_order_relaxed)) {
+        break;
+      }
+      if(!concurrent && node_budget && memory_policy == MctsMemoryPolicy::PRUNE &&
+         nodes.size() >= node_budget) {
+        Prune();
+      }
+      if(profiling) {
+        MonteCarloTreeSearch<true>(worker);
+      } else {
+        MonteCarloTreeSearch<false>(worker);
+      }
+      uint64_t depth = worker.path.size();
+      worker.depth_sum += depth;
+      worker.max_depth = std::max(worker.max_depth, int(depth));
+      iterations++;
+    }
+    return iterations;
+  }
+
+  size_t SearchForTime(double ms, SearchWorker& worker) {
+    auto budget = std::chrono::duration<double, std::milli>(ms);
+    return Search(std::numeric_limits<size_t>::max(),
+                  SearchClock::now() + std::chrono::duration_cast<SearchClock::duration>(budget),
+                  nullptr, worker);
+  }
+
+  size_t SearchForIterations(size_t n, SearchWorker& worker) {
+    return Search(n, SearchClock::time_point::max(), nullptr, worker);
+  }
+
+private:
+  static bool IsNode(uint32_t child) {
+    return child < kRetryExpansion;
+  }
+
+  // Whether a new node would fit into the arenas and the node budget.
+  bool HasRoom() const {
+    size_t size = nodes.size();
+    return (!node_budget || size < node_budget) && (!concurrent || size < nodes.capacity());
+  }
+
+  template <class T>
+  void Add(std::atomic<T>& value, T delta) {
+    if(concurrent) {
+      value.fetch_add(delta, std::memory_order_relaxed);
+    } else {
+      value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+  }
+
+  uint32_t NewNode(Game const& state, SearchWorker& worker) {
+    if(node_budget && nodes.size() >= node_budget) {
+      return kNoNode;
+    }
+    auto actions = state.GetAvailableActions();
+    Shuffle(actions.begin(), actions.end(), worker.rng);
+
+    uint32_t index, first_edge;
+    if(concurrent) {
+      index = nodes.AllocateShared(1);
+      first_edge = edges.AllocateShared(actions.size());
+      if(index == kNoNode || first_edge == kNoNode) {
+        return kNoNode;
+      }
+    } else {
+      index = nodes.Allocate(1);
+      first_edge = edges.Allocate(actions.size());
+    }
+
+    Node& node = nodes[index];
+    node.state = state;
+    node.visits = 0;
+    node.first_edge = first_edge;
+    node.num_edges = actions.size();
+    node.num_expanded = 0;
+    for(uint32_t i = 0; i < actions.size(); i++) {
+      Edge& edge = edges[first_edge + i];
+      edge.stats.wins = 0;
+      edge.stats.plays = 0;
+      edge.stats.virtual_loss = 0;
+      edge.child = kNoNode;
+      edge.action = actions[i];
+    }
+    return index;
+  }
+
+  // Looks for the node of the given position among the current root and the
+  // positions up to two plies below it, i.e. after our move and the reply.
+  // A DAG can answer directly from its transposition table.
+  uint32_t FindNode(uint64_t state_key) const {
+    if(root == kNoNode) {
+      return kNoNode;
+    }
+    if(use_transpositions) {
+      auto entry = transpositions.find(state_key);
+      return entry == transpositions.end() ? kNoNode : entry->second;
+    }
+    if(nodes[root].state.GetStateKey() == state_key) {
+      return root;
+    }
+    Node const& root_node = nodes[root];
+    for(uint32_t i = 0; i < root_node.num_expanded; i++) {
+      uint32_t child = edges[root_node.first_edge + i].child;
+      if(!IsNode(child)) {
+        continue;
+      }
+      if(nodes[child].state.GetStateKey() == state_key) {
+        return child;
+      }
+      Node const& child_node = nodes[child];
+      for(uint32_t j = 0; j < child_node.num_expanded; j++) {
+        uint32_t grandchild = edges[child_node.first_edge + j].child;
+        if(IsNode(grandchild) && nodes[grandchild].state.GetStateKey() == state_key) {
+          return grandchild;
+        }
+      }
+    }
+    return kNoNode;
+  }
+
+  // Makes new_root the root by copying the subtree below it into the spare
+  // arenas in breadth-first order and swapping them in. Everything outside
+  // the subtree is released by the swap in one step. Nodes are copied once
+  // however many edges lead to them, so shared DAG nodes stay shared.
+  void Reroot(uint32_t new_root) {
+    Compact(new_root, 0);
+  }
+
+  // Frees at least half of the node budget by dropping the nodes with the
+  // fewest visits, and with them everything only reachable through them.
+  // Children of the root are always kept.
+  void Prune() {
+    size_t old_size = nodes.size();
+    size_t keep = node_budget / 2;
+    reroot_queue.assign(1, root);
+    remap.assign(old_size, kNoNode);
+    remap[root] = 0;
+    for(size_t index = 0; index < reroot_queue.size(); index++) {
+      Node const& node = nodes[reroot_queue[index]];
+      for(uint32_t i = node.first_edge; i < node.first_edge + node.num_expanded; i++) {
+        uint32_t child = edges[i].child;
+        if(IsNode(child) && remap[child] == kNoNode) {
+          remap[child] = 0;
+          reroot_queue.push_back(child);
+        }
+      }
+    }
+
+    int min_visits = 0;
+    if(reroot_queue.size() > keep) {
+      prune_visits.clear();
+      for(uint32_t index : reroot_queue) {
+        prune_visits.push_back(nodes[index].visits);
+      }
+      std::nth_element(prune_visits.begin(), prune_visits.begin() + keep, prune_visits.end(),
+                       std::greater<int>());
+      min_visits = prune_visits[keep] + 1;
+    }
+    Compact(root, min_visits);
+    pruned_nodes += old_size - nodes.size();
+  }
+
+  // Copies the part of the subtree below new_root made of nodes with at
+  // least min_visits visits into the spare arenas in breadth-first order
+  // and swaps them in. The edges of every copied node are reordered so that
+  // those with a copied child come first; edges whose child was dropped
+  // keep their statistics but count as unexplored again.
+  void Compact(uint32_t new_root, int min_visits) {
+    spare_nodes.Clear();
+    spare_edges.Clear();
+    reroot_queue.clear();
+    remap.assign(nodes.size(), kNoNode);
+    transpositions.clear();
+    reroot_queue.push_back(new_root);
+    remap[new_root] = spare_nodes.Allocate(1);
+    for(size_t index = 0; index < reroot_queue.size(); index++) {
+      Node const& old_node = nodes[reroot_queue[index]];
+      uint32_t first_edge = spare_edges.Allocate(old_node.num_edges);
+      spare_nodes[index] = old_node;
+      spare_nodes[index].first_edge = first_edge;
+      if(use_transpositions) {
+        transpositions[old_node.state.GetStateKey()] = index;
+      }
+      uint32_t expanded = 0, dropped = old_node.num_expanded;
+      for(uint32_t i = 0; i < old_node.num_expanded; i++) {
+        Edge edge = edges[old_node.first_edge + i];
+        uint32_t child = edge.child;
+        if(IsNode(child) && remap[child] == kNoNode &&
+           (index == 0 || nodes[child].visits >= min_visits)) {
+          reroot_queue.push_back(child);
+          remap[child] = spare_nodes.Allocate(1);
+        }
+        if(!IsNode(child) || remap[child] == kNoNode) {
+          edge.child = kNoNode;
+          spare_edges[first_edge + --dropped] = edge;
+        } else {
+          edge.child = remap[child];
+          spare_edges[first_edge + expanded++] = edge;
+        }
+      }
+      for(uint32_t i = old_node.num_expanded; i < old_node.num_edges; i++) {
+        spare_edges[first_edge + i] = edges[old_node.first_edge + i];
+      }
+      spare_nodes[index].num_expanded = expanded;
+    }
+    std::swap(nodes, spare_nodes);
+    std::swap(edges, spare_edges);
+    root = 0;
+  }
+
+  double UpperConfidenceBound(Edge const& edge, double log_parent_visits) const {
+    int virtual_loss = edge.stats.virtual_loss.load(std::memory_order_relaxed);
+    double plays = edge.stats.plays.load(std::memory_order_relaxed) + virtual_loss;
+    double wins = edge.stats.wins.load(std::memory_order_relaxed) - virtual_loss;
+    double win_percentage = wins / plays;
+    double confidence_bound = sqrt(exploration_rate * log_parent_visits / plays);
+    return win_percentage + confidence_bound;
+  }
+
+  // Takes the next unexplored edge of node for this worker, or returns
+  // kNoNode if other workers already claimed all of them.
+  uint32_t ClaimUnexploredEdge(Node& node) {
+    uint8_t claimed = node.num_expanded.load(std::memory_order_relaxed);
+    while(claimed < node.num_edges) {
+      if(node.num_expanded.compare_exchange_weak(claimed, claimed + 1,
+                                                 std::memory_order_relaxed)) {
+        return node.first_edge + claimed;
+      }
+    }
+    return kNoNode;
+  }
+
+  // Descends from the root to a node with unexplored actions, recording the
+  // edges taken in the worker's path. Sets claimed_edge to the edge this
+  // worker should expand next, if any. Terminal leaves are scored and backed
+  // up here, in which case kNoNode is returned.
+  uint32_t Selection(SearchWorker& worker, uint32_t& claimed_edge) {
+    worker.path.clear();
+    uint32_t node_index = root;
+    while(true) {
+      Node& node = nodes[node_index];
+
+      //check for unexplored actions
+      claimed_edge = ClaimUnexploredEdge(node);
+      if(claimed_edge != kNoNode) {
+        return node_index;
+      }
+
+      if(node.num_edges == 0) {
+        Backpropagation(worker, rollouts_per_leaf * GetScore(node), rollouts_per_leaf);
+        return kNoNode;
+      }
+
+      //treat as bandit problem
+      double log_visits = log(std::max(node.visits.load(std::memory_order_relaxed), 1) * 1.0);
+      double best_value = -std::numeric_limits<double>::infinity();
+      uint32_t best_edge = kNoNode;
+      bool has_room = HasRoom();
+      for(uint32_t i = node.first_edge; i < node.first_edge + node.num_edges; i++) {
+        // Children still being built by another worker are skipped. Edges
+        // whose expansion failed are claimed again once there is room.
+        uint32_t child = edges[i].child.load(std::memory_order_acquire);
+        if(child == kRetryExpansion && has_room &&
+           edges[i].child.compare_exchange_strong(child, kNoNode, std::memory_order_relaxed)) {
+          claimed_edge = i;
+          return node_index;
+        }
+        if(!IsNode(child)) {
+          continue;
+        }
+        double ucb = UpperConfidenceBound(edges[i], log_visits);
+        if(ucb > best_value) {
+          best_value = ucb;
+          best_edge = i;
+        }
+      }
+
+      if(best_edge == kNoNode) {
+        return node_index;
+      }
+
+      if(concurrent) {
+        Add(edges[best_edge].stats.virtual_loss, 1);
+      }
+      worker.path.push_back(best_edge);
+      node_index = edges[best_edge].child.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Returns the new child, or node_index itself if the tree has no room
+  // left, in which case the caller simulates from the unexpanded node and
+  // the edge is marked to be retried. With transpositions a position that
+  // already has a node is linked instead of being added again.
+  uint32_t Expansion(SearchWorker& worker, uint32_t node_index, uint32_t edge_index) {
+    Game next_state = nodes[node_index].state.ForwardModel(edges[edge_index].action);
+
+    uint32_t child_index;
+    if(use_transpositions) {
+      std::unique_lock<SpinLock> lock(transpositions_lock, std::defer_lock);
+      if(concurrent) {
+        lock.lock();
+      }
+      auto entry = transpositions.find(next_state.GetStateKey());
+      worker.table_lookups++;
+      if(entry != transpositions.end()) {
+        child_index = entry->second;
+        worker.table_hits++;
+      } else {
+        child_index = NewNode(next_state, worker);
+        if(child_index != kNoNode) {
+          transpositions[next_state.GetStateKey()] = child_index;
+        }
+      }
+    } else {
+      child_index = NewNode(next_state, worker);
+    }
+    if(child_index == kNoNode) {
+      edges[edge_index].child.store(kRetryExpansion, std::memory_order_relaxed);
+      return node_index;
+    }
+    if(concurrent) {
+      Add(edges[edge_index].stats.virtual_loss, 1);
+    }
+    edges[edge_index].child.store(child_index, std::memory_order_release);
+    worker.path.push_back(edge_index);
+    return child_index;
+  }
+
+  // Total score of rollouts_per_leaf random playouts from the node.
+  int Simulation(SearchWorker& worker, uint32_t node_index) {
+    return RandomPlayoutScore(nodes[node_index].state, rollouts_per_leaf, worker.rng);
+  }
+
+  int GetScore(Node const& node) {
+    int score;
+    if(node.state.Draw()) {
+      score = 0;
+    } else {
+      score = 1;
+    }
+    return score;
+  }
+
+  // Score is the total of plays playouts, from the point of view of the
+  // player who made the last move on the path, and flips sign at every ply
+  // on the way back to the root.
+  void Backpropagation(SearchWorker& worker, int score, int plays) {
+    Add(nodes[root].visits, plays);
+    for(auto it = worker.path.rbegin(); it != worker.path.rend(); ++it) {
+      Edge& edge = edges[*it];
+      Add(edge.stats.plays, plays);
+      Add(edge.stats.wins, score);
+      if(concurrent) {
+        Add(edge.stats.virtual_loss, -1);
+      }
+      Add(nodes[edge.child.load(std::memory_order_relaxed)].visits, plays);
+      score = -score;
+    }
+  }
+
+  // With profiling the time of each phase is added to the worker. Terminal
+  // leaves are backed up inside Selection and count towards it.
+  template <bool profile>
+  void MonteCarloTreeSearch(SearchWorker& worker) {
+    SearchClock::time_point times[5];
+    if constexpr(profile) {
+      times[0] = SearchClock::now();
+    }
+    uint32_t claimed_edge;
+    uint32_t leaf = Selection(worker, claimed_edge);
+    if constexpr(profile) {
+      times[1] = SearchClock::now();
+      worker.phase_time[0] += times[1] - times[0];
+    }
+    if(leaf == kNoNode) {
+      return;
+    }
+
+    if(claimed_edge != kNoNode) {
+      leaf = Expansion(worker, leaf, claimed_edge);
+    }
+    if constexpr(profile) {
+      times[2] = SearchClock::now();
+    }
+    int reward = Simulation(worker, leaf);
+    if constexpr(profile) {
+      times[3] = SearchClock::now();
+    }
+    Backpropagation(worker, reward, rollouts_per_leaf);
+    if constexpr(profile) {
+      times[4] = SearchClock::now();
+      for(int phase = 1; phase < 4; phase++) {
+        worker.phase_time[phase] += times[phase + 1] - times[phase];
+      }
     }
-    double confidence_bound = sqrt(exploration_rate * log(parent->stats.plays * 1.0) / stats.plays);
-    return win_percentage + confidence_bound; 
   }
 
-  GameStats stats;
-  Game state;
-  bool our_turn;
-  typename Game::Action action;
   float exploration_rate;
-  std::vector<TreeNodePtr> children;
-  std::vector<typename Game::Action> unexplored_actions;
-  TreeNodePtr parent;
+  int rollouts_per_leaf;
+  bool profiling;
+  bool concurrent;
+  bool use_transpositions;
+  size_t node_budget;
+  MctsMemoryPolicy memory_policy;
+  size_t pruned_nodes;
+  FlatHashMap<uint64_t, uint32_t> transpositions;
+  SpinLock transpositions_lock;
+  NodeArena<Node> nodes;
+  NodeArena<Edge> edges;
+  NodeArena<Node> spare_nodes;
+  NodeArena<Edge> spare_edges;
+  std::vector<uint32_t> reroot_queue;
+  std::vector<uint32_t> remap;
+  std::vector<int> prune_visits;
+  uint32_t root;
 };
 
 template <class Game>
 class MonteCarloTreeSearchAgent {
 public:
-  MonteCarloTreeSearchAgent() : exploration_rate(2), iteration_limit(100) { }  
-  using TreeNodePtr = TreeNode<Game>*;
+  using Node = TreeNode<Game>;
+  using Edge = TreeEdge<Game>;
+
+  MonteCarloTreeSearchAgent()
+    : iteration_limit(100), time_limit_ms(0), exploration_rate(2), rollouts_per_leaf(1),
+      reuse_tree(true), pondering(false), use_transpositions(false),
+      parallelism(MctsParallelism::ROOT), trees(1), workers(1),
+      seeded(false), base_seed(0), iterations_per_ms(0), profiling(false), search_log(nullptr),
+      node_budget(0), memory_policy(MctsMemoryPolicy::PRUNE) { }
+
+  // The ponder task is declared first, so a copy stops the source's
+  // background search before the trees are copied, and is destroyed last,
+  // so it is stopped here.
+  ~MonteCarloTreeSearchAgent() {
+    ponder_task.Stop();
+  }
 
   typename Game::Action GetAction(const Game& state) {
-   auto root_node = std::unique_ptr<TreeNode<Game>>(new TreeNode<Game>(state, true, nullptr, typename Game::Action(), exploration_rate));
-   search_tree = root_node.get();
-   nodes.clear();
-   nodes.push_back(std::move(root_node));
+   ponder_task.Stop();
 
-   SearchForIterations(iteration_limit);
+   if(time_limit_ms > 0) {
+     auto budget = std::chrono::duration<double, std::milli>(time_limit_ms);
+     Search(state, std::numeric_limits<size_t>::max(),
+            SearchClock::now() + std::chrono::duration_cast<SearchClock::duration>(budget),
+            nullptr, &report);
+   } else {
+     Search(state, iteration_limit, SearchClock::time_point::max(), nullptr, &report);
+   }
+   typename Game::Action action = BestAction();
+   ReportMove(action);
 
-   double best_value = -10;
-   typename Game::Action best_action;
-   for(auto const& child : search_tree->children) {
-     double value = child->stats.plays;
-     if(value >= best_value) {
-       best_value = value;
-       best_action = child->action;
+   if(pondering) {
+     Game expected_state = state.ForwardModel(action);
+     if(!expected_state.GameOver()) {
+       ponder_task.Start([this, expected_state](std::atomic<bool> const& stop) {
+         Search(expected_state, std::numeric_limits<size_t>::max(),
+                SearchClock::time_point::max(), &stop, nullptr);
+       });
      }
    }
-
-   return best_action;
+   return action;
   }
 
   void TakeAction(Game& game) {
     game.ApplyAction(GetAction(game));
   }
 
-  void Reset() { }
+  void Reset() {
+    ponder_task.Stop();
+    for(SearchTree<Game>& tree : trees) {
+      tree.Clear();
+    }
+  }
 
+  // Iterations are per worker thread.
   void SetIterationLimit(size_t iterations) {
+    ponder_task.Stop();
     iteration_limit = iterations;
   }
 
+  // Search each move for the given wall-clock time instead of a fixed number
+  // of iterations. Zero or less goes back to the iteration limit.
+  void SetTimeLimit(double ms) {
+    ponder_task.Stop();
+    time_limit_ms = ms;
+  }
+
+  // Keep searching on a background thread from the position after our move
+  // until the next GetAction call, which then continues from the subtree of
+  // the opponent's reply. Only useful together with tree reuse.
+  void SetPondering(bool ponder) {
+    ponder_task.Stop();
+    pondering = ponder;
+  }
+
   void SetExplorationRate(float rate) {
+    ponder_task.Stop();
     exploration_rate = rate;
   }
 
-private:
-  void SearchForTime(double ms) {
-   const int batch_size = 1000;
-   Stopwatch sw;
-   sw.Start();
-   int iterations = 0;
-   while(sw.ElapsedMillis() < ms) {
-    SearchForIterations(batch_size);
-    iterations += batch_size;
-   }
-   sw.Stop();
+  // Statistics of the search behind the last GetAction.
+  SearchReport const& LastSearchReport() const {
+    return report;
+  }
+
+  // Also time the selection, expansion, simulation and backpropagation
+  // phases of every iteration for the report. Off by default, as it reads
+  // the clock five times per iteration.
+  void SetProfiling(bool enabled) {
+    ponder_task.Stop();
+    profiling = enabled;
   }
 
-  void SearchForIterations(int n) {
-    for(int i = 0; i < n; i++) {
-       MonteCarloTreeSearch(search_tree);
-     }   
+  // Writes the report of every move to log as a JSON line. Pass nullptr to
+  // stop.
+  void SetSearchLog(SearchLog* log) {
+    ponder_task.Stop();
+    search_log = log;
   }
 
-  TreeNodePtr Selection(TreeNodePtr node) {
-    if(node == nullptr) {
-      return node;
+  // Random playouts run from each new leaf. Several playouts per leaf give
+  // a less noisy value for the cost of one descent, and are cheap for games
+  // with a batched playout engine such as ConnectFour.
+  void SetRolloutsPerLeaf(int count) {
+    ponder_task.Stop();
+    rollouts_per_leaf = std::max(count, 1);
+  }
+
+  // Keep the search tree between moves and continue from the subtree of the
+  // position we are asked to play, instead of starting from scratch.
+  void SetTreeReuse(bool reuse) {
+    ponder_task.Stop();
+    reuse_tree = reuse;
+  }
+
+  // With ROOT parallelism each thread grows an independent tree from the
+  // same root and the root statistics are merged. With TREE parallelism all
+  // threads grow one shared tree, spread out by virtual loss.
+  void SetThreadCount(size_t num_threads) {
+    ponder_task.Stop();
+    num_threads = std::max<size_t>(num_threads, 1);
+    workers.resize(num_threads);
+    if(seeded) {
+      SetSeed(base_seed);
     }
-  
-    //check for unexplored actions
-    size_t num_unexplored_actions = node->unexplored_actions.size();
-    if(num_unexplored_actions != 0) {
-      return node;
+    trees.resize(parallelism == MctsParallelism::ROOT ? num_threads : 1);
+    for(SearchTree<Game>& tree : trees) {
+      tree.SetTranspositions(use_transpositions);
+      tree.SetNodeBudget(node_budget, memory_policy);
     }
+  }
 
-    //treat as bandit problem
-    double best_value = -std::numeric_limits<double>::infinity();
-    TreeNodePtr best_child = nullptr;
-    for(auto const& child : node->children) {
-      double ucb = child->UpperConfidenceBound();
-      if(ucb > best_value) {
-        best_value = ucb;
-        best_child = child;
-      }
+  // Caps every tree at max_nodes nodes, so that memory stays flat however
+  // long the agent searches or ponders; zero removes the cap. With ROOT
+  // parallelism each thread's tree has the full budget. The policy decides
+  // what happens once a tree is full; both keep searching, at the cost of a
+  // shallower tree than an unbounded search would build.
+  void SetNodeBudget(size_t max_nodes, MctsMemoryPolicy policy = MctsMemoryPolicy::PRUNE) {
+    ponder_task.Stop();
+    node_budget = max_nodes;
+    memory_policy = policy;
+    for(SearchTree<Game>& tree : trees) {
+      tree.SetNodeBudget(node_budget, memory_policy);
     }
-    
-    if(!best_child) {
-     int score = GetScore(node);
-     Backpropagation(node, score);
-     return nullptr;
+  }
+
+  // The node budget that fits each tree into about the given number of
+  // bytes, counting every node as if it had the most edges a position can
+  // have. Set transpositions first, they add to the cost of a node.
+  void SetMemoryBudget(size_t bytes, MctsMemoryPolicy policy = MctsMemoryPolicy::PRUNE) {
+    size_t max_nodes = bytes / SearchTree<Game>::BytesPerNode(use_transpositions);
+    SetNodeBudget(bytes ? std::max<size_t>(max_nodes, 1) : 0, policy);
+  }
+
+  // Share one node between all move orders that reach the same position,
+  // turning the tree into a DAG. Selection then uses the statistics of the
+  // edge taken together with the visits of the shared parent node.
+  void SetTranspositions(bool enabled) {
+    ponder_task.Stop();
+    use_transpositions = enabled;
+    for(SearchTree<Game>& tree : trees) {
+      tree.SetTranspositions(enabled);
     }
-     
-    return Selection(best_child); 
   }
 
-  TreeNodePtr Expansion(TreeNodePtr node) {
-    
-    if(node->state.GameOver()) {
-      std::cout << "Tried to expand a terminal state" << std::endl;
+  // Reseeds every worker's generator. Searches with a fixed iteration limit
+  // are then reproducible, except for TREE parallelism where the outcome
+  // depends on thread scheduling.
+  void SetSeed(uint64_t seed) {
+    ponder_task.Stop();
+    base_seed = seed;
+    seeded = true;
+    for(size_t i = 0; i < workers.size(); i++) {
+      workers[i].rng.Seed(seed + i);
     }
+  }
 
-    auto action = node->unexplored_actions.back();
-    node->unexplored_actions.pop_back();
-    Game next_state = node->state.ForwardModel(action);
-    
-    auto child_node = std::unique_ptr<TreeNode<Game>>(new TreeNode<Game>(next_state, !node->our_turn, node, action, exploration_rate));
-    node->children.push_back(child_node.get());
-    nodes.push_back(std::move(child_node));
-    return node->children.back();
+  void SetParallelism(MctsParallelism mode) {
+    ponder_task.Stop();
+    parallelism = mode;
+    SetThreadCount(workers.size());
   }
 
-  int Simulation(TreeNodePtr node) {
-    Game simulated_game = node->state;
-    bool our_turn = node->our_turn;
-    
-    while(!simulated_game.GameOver()) {
-      auto actions = simulated_game.GetAvailableActions();
-      simulated_game.ApplyAction(*select_randomly(actions.begin(), actions.end()));
-      our_turn = !our_turn;
+private:
+  // Searches from state on every worker until one of the limits is hit.
+  // Fills in the search statistics of the report unless it is null.
+  void Search(const Game& state,
+              size_t max_iterations,
+              SearchClock::time_point deadline,
+              std::atomic<bool> const* stop,
+              SearchReport* report) {
+    auto start = SearchClock::now();
+    std::atomic<size_t> iterations(0);
+    std::atomic<size_t> reused_nodes(0);
+    for(SearchWorker& worker : workers) {
+      worker.ResetStatistics();
     }
-
-    int score;
-    if(simulated_game.Draw()) {
-      score = 0;
-    } else if(our_turn == node->our_turn) {
-      score = 1;
+    for(SearchTree<Game>& tree : trees) {
+      tree.SetProfiling(profiling && report);
+    }
+    if(parallelism == MctsParallelism::TREE) {
+      SearchTree<Game>& tree = trees[0];
+      tree.SetExplorationRate(exploration_rate);
+      tree.SetRolloutsPerLeaf(rollouts_per_leaf);
+      reused_nodes += tree.SetRoot(state, reuse_tree, workers[0]);
+      tree.PrepareSearch(workers.size(), ExpectedIterations(max_iterations, deadline));
+      ParallelFor(workers.size(), [&](size_t worker) {
+        iterations += tree.Search(max_iterations, deadline, stop, workers[worker]);
+      });
     } else {
-      score = -1;
+      ParallelFor(trees.size(), [&](size_t worker) {
+        SearchTree<Game>& tree = trees[worker];
+        tree.SetExplorationRate(exploration_rate);
+        tree.SetRolloutsPerLeaf(rollouts_per_leaf);
+        reused_nodes += tree.SetRoot(state, reuse_tree, workers[worker]);
+        tree.PrepareSearch(1, max_iterations);
+        iterations += tree.Search(max_iterations, deadline, stop, workers[worker]);
+      });
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(SearchClock::now() - start).count();
+    if(elapsed_ms > 0) {
+      iterations_per_ms = iterations / elapsed_ms / workers.size();
+    }
+    if(!report) {
+      return;
+    }
+
+    *report = SearchReport();
+    report->agent = "mcts";
+    report->iterations = iterations;
+    report->elapsed_ms = elapsed_ms;
+    report->reused_nodes = reused_nodes;
+    uint64_t depth_sum = 0;
+    for(SearchWorker const& worker : workers) {
+      depth_sum += worker.depth_sum;
+      report->max_depth = std::max(report->max_depth, worker.max_depth);
+      report->table_lookups += worker.table_lookups;
+      report->table_hits += worker.table_hits;
+      using Millis = std::chrono::duration<double, std::milli>;
+      report->selection_ms += Millis(worker.phase_time[0]).count();
+      report->expansion_ms += Millis(worker.phase_time[1]).count();
+      report->simulation_ms += Millis(worker.phase_time[2]).count();
+      report->backpropagation_ms += Millis(worker.phase_time[3]).count();
+    }
+    report->average_depth = iterations ? double(depth_sum) / iterations : 0;
+    for(SearchTree<Game> const& tree : trees) {
+      report->tree_nodes += tree.NumNodes();
+      report->pruned_nodes += tree.NumPrunedNodes();
+      report->bytes_used += tree.BytesUsed();
     }
-    return score;
   }
 
-  int GetScore(TreeNodePtr const& node) {
-    int score;
-    if(node->state.Draw()) {
-      score = 0;
-    } else {
-      score = 1;
+  // Completes the report with the chosen move and logs it.
+  void ReportMove(typename Game::Action const& action) {
+    trees[0].PrincipalVariation(action, report.principal_variation);
+    Node const& root_node = trees[0].RootNode();
+    int plays[Game::Actions::capacity()];
+    int wins[Game::Actions::capacity()];
+    MergeRootStats(plays, wins);
+    for(uint32_t i = 0; i < root_node.num_edges; i++) {
+      if(trees[0].GetEdge(root_node.first_edge + i).action == action && plays[i] > 0) {
+        report.score = double(wins[i]) / plays[i];
+      }
+    }
+    if(search_log) {
+      search_log->Write(report);
     }
-    return score;
   }
 
-  void Backpropagation(TreeNodePtr node, int score) {
-    node->stats.plays++;
-    node->stats.wins += score;
-    if(node->parent) {
-      Backpropagation(node->parent, -score);
+  // Per-worker iteration estimate used to size a shared tree. Open-ended
+  // searches are sized from the speed of earlier searches; once the
+  // reservation is used up the shared tree stops growing and the remaining
+  // iterations only refine the statistics of existing nodes.
+  size_t ExpectedIterations(size_t max_iterations, SearchClock::time_point deadline) const {
+    const size_t minimum = 1 << 14;
+    if(max_iterations != std::numeric_limits<size_t>::max()) {
+      return max_iterations;
     }
+    double ms = time_limit_ms > 0 ? time_limit_ms : 1000;
+    if(deadline != SearchClock::time_point::max()) {
+      ms = std::chrono::duration<double, std::milli>(deadline - SearchClock::now()).count();
+    }
+    return std::max<size_t>(minimum, 2 * iterations_per_ms * ms);
+  }
+
+  // Sums the root edge statistics of every tree onto the edges of the first
+  // tree, in the order of its root's edges.
+  void MergeRootStats(int* plays, int* wins) const {
+   size_t num_trees = parallelism == MctsParallelism::ROOT ? trees.size() : 1;
+   Node const& root_node = trees[0].RootNode();
+   std::fill(plays, plays + root_node.num_edges, 0);
+   std::fill(wins, wins + root_node.num_edges, 0);
+   for(size_t t = 0; t < num_trees; t++) {
+     Node const& other_root = trees[t].RootNode();
+     for(uint32_t i = 0; i < other_root.num_edges; i++) {
+       Edge const& other_edge = trees[t].GetEdge(other_root.first_edge + i);
+       for(uint32_t j = 0; j < root_node.num_edges; j++) {
+         if(trees[0].GetEdge(root_node.first_edge + j).action == other_edge.action) {
+           plays[j] += other_edge.stats.plays;
+           wins[j] += other_edge.stats.wins;
+           break;
+         }
+       }
+     }
+   }
   }
 
-  void MonteCarloTreeSearch(TreeNodePtr node) {
-    TreeNodePtr unexpanded_child = Selection(node);
+  // The most visited action over all trees.
+  typename Game::Action BestAction() const {
+   Node const& root_node = trees[0].RootNode();
+   int plays[Game::Actions::capacity()];
+   int wins[Game::Actions::capacity()];
+   MergeRootStats(plays, wins);
 
-    if(unexpanded_child) {
-      TreeNodePtr expanded_node = Expansion(unexpanded_child);
-      double reward = Simulation(expanded_node);
-      Backpropagation(expanded_node, reward);
-    } 
+   double best_value = -10;
+   typename Game::Action best_action;
+   for(uint32_t i = 0; i < root_node.num_edges; i++) {
+     double value = plays[i];
+     if(value >= best_value) {
+       best_value = value;
+       best_action = trees[0].GetEdge(root_node.first_edge + i).action;
+     }
+   }
+
+   return best_action;
   }
 
+  BackgroundTask ponder_task;
   size_t iteration_limit;
+  double time_limit_ms;
   float exploration_rate;
-  std::vector<std::unique_ptr<TreeNode<Game>> > nodes;
-  TreeNodePtr search_tree;
+  int rollouts_per_leaf;
+  bool reuse_tree;
+  bool pondering;
+  bool use_transpositions;
+  MctsParallelism parallelism;
+  std::vector<SearchTree<Game>> trees;
+  std::vector<SearchWorker> workers;
+  bool seeded;
+  uint64_t base_seed;
+  double iterations_per_ms;
+  bool profiling;
+  SearchLog* search_log;
+  size_t node_budget;
+  MctsMemoryPolicy memory_policy;
+  SearchReport report;
 };
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <Eigen/Dense>
+#include "Random.h"
+#include "utils.h"
+
+// Value function approximated as a sum of n-tuple weights. Each tuple is a
+// fixed list of board cells; the contents of those cells (empty, x or o)
+// select one of its 3^n weights. The value is from the first player's point
+// of view, and memory is fixed by the tuples whatever the size of the state
+// space. Games must expose GetCell(row, col) and an Eigen BoardStateType.
+//
+// By default the tuples are every straight line of min(4, rows, cols) cells
+// and every 2x2 square, which for TicTacToe covers the winning lines and
+// for ConnectFour every group of four.
+template <class Game>
+class NTupleNetwork {
+public:
+    static constexpr int rows = Game::BoardStateType::RowsAtCompileTime;
+    static constexpr int cols = Game::BoardStateType::ColsAtCompileTime;
+    static constexpr int num_cells = rows * cols;
+
+    // Cell contents of a batch of positions, one column per position:
+    // 0 empty, 1 x, 2 o. Cell row * cols + col is row `row * cols + col`.
+    using Cells = Eigen::Array<int, num_cells, Eigen::Dynamic>;
+
+    NTupleNetwork() {
+        int length = std::min(4, std::min(rows, cols));
+        const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        for(auto const& direction : directions) {
+            for(int row = 0; row < rows; row++) {
+                for(int col = 0; col < cols; col++) {
+                    int end_row = row + (length - 1) * direction[0];
+                    int end_col = col + (length - 1) * direction[1];
+                    if(end_row >= rows || end_col < 0 || end_col >= cols) {
+                        continue;
+                    }
+                    std::vector<int> tuple;
+                    for(int k = 0; k < length; k++) {
+                        tuple.push_back((row + k * direction[0]) * cols + col + k * direction[1]);
+                    }
+                    AddTuple(tuple);
+                }
+            }
+        }
+        for(int row = 0; row + 1 < rows; row++) {
+            for(int col = 0; col + 1 < cols; col++) {
+                int cell = row * cols + col;
+                AddTuple({cell, cell + 1, cell + cols, cell + cols + 1});
+            }
+        }
+    }
+
+    void AddTuple(std::vector<int> const& cells) {
+        int weights_in_tuple = 1;
+        for(size_t k = 0; k < cells.size(); k++) {
+            weights_in_tuple *= 3;
+        }
+        tuples.push_back(cells);
+        offsets.push_back(weights.size());
+        weights.conservativeResize(weights.size() + weights_in_tuple);
+        weights.tail(weights_in_tuple).setZero();
+    }
+
+    static void ReadCells(const Game& state, Cells& cells, int column) {
+        for(int row = 0; row < rows; row++) {
+            for(int col = 0; col < cols; col++) {
+                char cell = state.GetCell(row, col);
+                cells(row * cols + col, column) = cell == 'x' ? 1 : cell == 'o' ? 2 : 0;
+            }
+        }
+    }
+
+    // Values of every position in the batch. The weight indices of each
+    // tuple are computed for the whole batch at once.
+    Eigen::ArrayXf Evaluate(Cells const& cells) const {
+        Eigen::ArrayXf values = Eigen::ArrayXf::Zero(cells.cols());
+        Eigen::ArrayXi index(cells.cols());
+        for(size_t t = 0; t < tuples.size(); t++) {
+            index = cells.row(tuples[t][0]).transpose();
+            for(size_t k = 1; k < tuples[t].size(); k++) {
+                index = index * 3 + cells.row(tuples[t][k]).transpose();
+            }
+            index += offsets[t];
+            values += weights(index);
+        }
+        return values;
+    }
+
+    float Evaluate(const Game& state) const {
+        Cells cells(num_cells, 1);
+        ReadCells(state, cells, 0);
+        return Evaluate(cells)(0);
+    }
+
+    // Adds delta to every weight that contributes to the value of state.
+    void Update(const Game& state, float delta) {
+        Cells cells(num_cells, 1);
+        ReadCells(state, cells, 0);
+        for(size_t t = 0; t < tuples.size(); t++) {
+            int index = 0;
+            for(int cell : tuples[t]) {
+                index = index * 3 + cells(cell, 0);
+            }
+            weights(offsets[t] + index) += delta;
+        }
+    }
+
+    size_t NumTuples() const {
+        return tuples.size();
+    }
+
+    size_t NumWeights() const {
+        return weights.size();
+    }
+
+private:
+    std::vector<std::vector<int>> tuples;
+    std::vector<int> offsets;
+    Eigen::ArrayXf weights;
+};
+
+// TD(0) agent with the same afterstate learning rule as
+// TemporalDifferenceAgent, but learning into an NTupleNetwork instead of a
+// table, so that it generalises between positions and fits games far too
+// large to tabulate. Agents that share a network learn together.
+template <class Game>
+class NTupleAgent {
+public:
+    NTupleAgent(NTupleNetwork<Game>* network)
+     : network(network) { }
+
+    // Evaluates the positions after every action in one batch.
+    typename Game::Action GreedyAction(const Game& state,
+                                       const typename Game::Actions& actions, float& best_value) {
+        typename NTupleNetwork<Game>::Cells cells(NTupleNetwork<Game>::num_cells, actions.size());
+        for(uint32_t i = 0; i < actions.size(); i++) {
+            NTupleNetwork<Game>::ReadCells(state.ForwardModel(actions[i]), cells, i);
+        }
+        Eigen::ArrayXf values = value_sign * network->Evaluate(cells);
+
+        Eigen::Index best;
+        best_value = value_sign * values.maxCoeff(&best);
+        return actions[best];
+    }
+
+    void TakeAction(Game& game) {
+        auto actions = game.GetAvailableActions();
+        value_sign = game.FirstPlayersTurn() ? 1.0f : -1.0f;
+        float best_value;
+        typename Game::Action action = GreedyAction(game, actions, best_value);
+        if(ThreadRng().UniformFloat() <= epsilon) {
+            action = *select_randomly(actions.begin(), actions.end());
+        }
+        Game state = game;
+        float reward = game.ApplyAction(action);
+        if(alpha == 0) {
+            return;
+        }
+
+        // Each of the NumTuples() weights of a position moves by an equal
+        // share of the step.
+        float step = alpha / network->NumTuples();
+        if(game.GameOver()) {
+            network->Update(game, step * (reward - network->Evaluate(game)));
+        }
+        network->Update(state, step * (best_value - network->Evaluate(state)));
+    }
+
+    void SetLearningRate(float alpha) {
+        this->alpha = alpha;
+    }
+
+    void SetExplorationRate(float epsilon) {
+        this->epsilon = epsilon;
+    }
+
+    void Reset() {
+
+    }
+
+private:
+    NTupleNetwork<Game>* network;
+    float value_sign = 1.0;
+    float alpha = 0.05; //learning rate
+    float epsilon = 0.05; //exploration rate
+};
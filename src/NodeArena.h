@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "Parallel.h"
+
+const uint32_t kNoNode = std::numeric_limits<uint32_t>::max();
+
+// Bump allocator for search tree nodes. Slots are handed out as contiguous
+// index ranges and released all at once by Clear(), which keeps the backing
+// storage so that the next search does not touch the heap. Callers must
+// initialise every slot they allocate; recycled slots keep stale contents.
+template <class T>
+class NodeArena {
+public:
+  NodeArena() : size_(0), max_growth_(std::numeric_limits<size_t>::max()) { }
+
+  uint32_t Allocate(uint32_t count) {
+    uint32_t first = size();
+    size_ = first + count;
+    if(first + count > slots_.size()) {
+      size_t grown = std::min(2 * slots_.size(), max_growth_);
+      slots_.resize(std::max<size_t>(first + count, grown));
+    }
+    return first;
+  }
+
+  // Thread-safe variant of Allocate that never grows the storage. Returns
+  // kNoNode once the reserved capacity is used up.
+  uint32_t AllocateShared(uint32_t count) {
+    uint32_t first = size_.fetch_add(count, std::memory_order_relaxed);
+    if(first + count > slots_.size()) {
+      return kNoNode;
+    }
+    return first;
+  }
+
+  void Reserve(size_t count) {
+    if(count > slots_.size()) {
+      slots_.resize(count);
+    }
+  }
+
+  // Allocate grows the storage by doubling, but not past count slots
+  // unless a single allocation needs more.
+  void SetMaxGrowth(size_t count) {
+    max_growth_ = count;
+  }
+
+  void Clear() {
+    size_ = 0;
+  }
+
+  T& operator[](uint32_t index) {
+    return slots_[index];
+  }
+
+  T const& operator[](uint32_t index) const {
+    return slots_[index];
+  }
+
+  size_t size() const {
+    return std::min<size_t>(size_.load(std::memory_order_relaxed), slots_.size());
+  }
+
+  size_t capacity() const {
+    return slots_.size();
+  }
+
+  size_t BytesUsed() const {
+    return slots_.size() * sizeof(T);
+  }
+
+private:
+  std::vector<T> slots_;
+  CopyableAtomic<uint32_t> size_;
+  size_t max_growth_;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs fn(worker) for every worker in [0, num_workers) concurrently and
+// waits for all of them. Worker 0 runs on the calling thread, so a single
+// worker never starts a thread.
+template <class Fn>
+void ParallelFor(size_t num_workers, Fn fn) {
+  std::vector<std::thread> threads;
+  if(num_workers > 1) {
+    threads.reserve(num_workers - 1);
+  }
+  for(size_t worker = 1; worker < num_workers; worker++) {
+    threads.emplace_back(fn, worker);
+  }
+  fn(0);
+  for(std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+// std::atomic that can be copied while no other thread is touching it, so
+// that structures holding it can still live in growable or compacted
+// storage. All operations used through it are relaxed unless stated.
+template <class T>
+struct CopyableAtomic : std::atomic<T> {
+  CopyableAtomic(T value = T()) : std::atomic<T>(value) { }
+
+  CopyableAtomic(CopyableAtomic const& other)
+    : std::atomic<T>(other.load(std::memory_order_relaxed)) { }
+
+  CopyableAtomic& operator=(CopyableAtomic const& other) {
+    this->store(other.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+  }
+
+  CopyableAtomic& operator=(T value) {
+    this->store(value, std::memory_order_relaxed);
+    return *this;
+  }
+};
+
+// A single background job that can be asked to stop. The job receives the
+// stop flag and is expected to poll it. Copies start out idle, and copying
+// or assigning stops the job of the source as well, so that an owner
+// declaring the task before the state the job works on is copied only once
+// the job has returned.
+class BackgroundTask {
+public:
+  BackgroundTask() : stop_(false) { }
+
+  BackgroundTask(BackgroundTask const& other) : stop_(false) {
+    other.Stop();
+  }
+
+  BackgroundTask& operator=(BackgroundTask const& other) {
+    Stop();
+    other.Stop();
+    return *this;
+  }
+
+  ~BackgroundTask() {
+    Stop();
+  }
+
+  void Start(std::function<void(std::atomic<bool> const&)> job) {
+    Stop();
+    stop_ = false;
+    thread_ = std::thread([this, job]() { job(stop_); });
+  }
+
+  // Raises the stop flag and waits for the job to return.
+  void Stop() const {
+    if(thread_.joinable()) {
+      stop_ = true;
+      thread_.join();
+    }
+  }
+
+  bool Running() const {
+    return thread_.joinable();
+  }
+
+private:
+  mutable std::atomic<bool> stop_;
+  mutable std::thread thread_;
+};
+
+// Test-and-test-and-set lock for very short critical sections. Copies start
+// unlocked.
+class SpinLock {
+public:
+  SpinLock() : locked_(false) { }
+
+  SpinLock(SpinLock const&) : locked_(false) { }
+
+  SpinLock& operator=(SpinLock const&) {
+    return *this;
+  }
+
+  void lock() {
+    while(locked_.exchange(true, std::memory_order_acquire)) {
+      while(locked_.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void unlock() {
+    locked_.store(false, std::memory_order_release);
+  }
+
+private:
+  std::atomic<bool> locked_;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <utility>
+
+inline uint64_t SplitMix64(uint64_t& state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// xoshiro256** generator. Small, fast and good enough for rollouts and
+// exploration; it also satisfies UniformRandomBitGenerator so it can be
+// handed to the standard library.
+class Xoshiro256 {
+public:
+  using result_type = uint64_t;
+
+  explicit Xoshiro256(uint64_t seed = 0) {
+    Seed(seed);
+  }
+
+  // Expands a 64-bit seed into the full state with splitmix64, so that
+  // nearby seeds give unrelated streams.
+  void Seed(uint64_t seed) {
+    for(uint64_t& word : s_) {
+      word = SplitMix64(seed);
+    }
+  }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type(0); }
+
+  result_type operator()() {
+    uint64_t result = Rotl(s_[1] * 5, 7) * 9;
+    uint64_t t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = Rotl(s_[3], 45);
+    return result;
+  }
+
+  // Integer in [0, bound) by multiply-shift (Lemire), without division or
+  // rejection loop. The bias is below 2^-32 for the small bounds used here.
+  uint32_t Below(uint32_t bound) {
+    return ((*this)() >> 32) * bound >> 32;
+  }
+
+  // Float in [0, 1).
+  float UniformFloat() {
+    return ((*this)() >> 40) * (1.0f / (1 << 24));
+  }
+
+private:
+  static uint64_t Rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  uint64_t s_[4];
+};
+
+// Generator of the calling thread, used wherever no explicit generator is
+// passed. Each thread starts from a random seed; call SeedThreadRng to make
+// the thread's stream reproducible.
+inline Xoshiro256& ThreadRng() {
+  thread_local Xoshiro256 rng((uint64_t(std::random_device()()) << 32) ^ std::random_device()());
+  return rng;
+}
+
+inline void SeedThreadRng(uint64_t seed) {
+  ThreadRng().Seed(seed);
+}
+
+template <class RandomGenerator>
+inline size_t RandomIndex(size_t size, RandomGenerator& g) {
+  std::uniform_int_distribution<size_t> dis(0, size - 1);
+  return dis(g);
+}
+
+inline size_t RandomIndex(size_t size, Xoshiro256& g) {
+  return g.Below(size);
+}
+
+// Fisher-Yates shuffle drawing from RandomIndex.
+template <class Iter, class RandomGenerator>
+inline void Shuffle(Iter start, Iter end, RandomGenerator& g) {
+  auto size = std::distance(start, end);
+  for(auto i = size - 1; i > 0; i--) {
+    std::swap(start[i], start[RandomIndex(i + 1, g)]);
+  }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// What an agent did to choose its last move. Fields that do not apply to
+// the agent stay zero: MCTS counts iterations, minimax counts nodes.
+struct SearchReport {
+  std::string agent;
+  uint64_t iterations = 0;
+  uint64_t nodes_searched = 0;
+  double elapsed_ms = 0;
+
+  // Depth below the root of the leaves reached (MCTS) or of the nodes
+  // visited (minimax).
+  int max_depth = 0;
+  double average_depth = 0;
+  int completed_depth = 0;  // minimax iterative deepening
+
+  // Size of the search structures after the search: nodes of the MCTS
+  // tree, slots of the minimax transposition table or solved positions.
+  // reused_nodes is the part of the MCTS tree carried over from earlier
+  // moves, pruned_nodes the nodes released during the search to stay
+  // within a node budget.
+  uint64_t tree_nodes = 0;
+  uint64_t reused_nodes = 0;
+  uint64_t pruned_nodes = 0;
+  uint64_t bytes_used = 0;
+
+  // Transposition table lookups, and how many found an entry.
+  uint64_t table_lookups = 0;
+  uint64_t table_hits = 0;
+
+  // Time per MCTS phase, summed over the workers. Only measured when
+  // profiling is enabled on the agent.
+  double selection_ms = 0;
+  double expansion_ms = 0;
+  double simulation_ms = 0;
+  double backpropagation_ms = 0;
+
+  // MCTS: mean playout score of the chosen move in [-1, 1] over all trees.
+  // Minimax: root score, with wins at +/- MinimaxAgent::kWinScore.
+  double score = 0;
+  std::vector<std::string> principal_variation;
+
+  double IterationsPerSecond() const {
+    return elapsed_ms > 0 ? iterations / elapsed_ms * 1000 : 0;
+  }
+
+  double NodesPerSecond() const {
+    return elapsed_ms > 0 ? nodes_searched / elapsed_ms * 1000 : 0;
+  }
+
+  double TableHitRate() const {
+    return table_lookups ? double(table_hits) / table_lookups : 0;
+  }
+
+  // One JSON object on a single line.
+  std::string ToJson() const {
+    std::string json = "{\"agent\":\"" + agent + "\"";
+    AddField(json, "iterations", iterations);
+    AddField(json, "nodes_searched", nodes_searched);
+    AddField(json, "elapsed_ms", elapsed_ms);
+    AddField(json, "iterations_per_second", IterationsPerSecond());
+    AddField(json, "nodes_per_second", NodesPerSecond());
+    AddField(json, "max_depth", max_depth);
+    AddField(json, "average_depth", average_depth);
+    AddField(json, "completed_depth", completed_depth);
+    AddField(json, "tree_nodes", tree_nodes);
+    AddField(json, "reused_nodes", reused_nodes);
+    AddField(json, "pruned_nodes", pruned_nodes);
+    AddField(json, "bytes_used", bytes_used);
+    AddField(json, "table_lookups", table_lookups);
+    AddField(json, "table_hits", table_hits);
+    AddField(json, "table_hit_rate", TableHitRate());
+    AddField(json, "selection_ms", selection_ms);
+    AddField(json, "expansion_ms", expansion_ms);
+    AddField(json, "simulation_ms", simulation_ms);
+    AddField(json, "backpropagation_ms", backpropagation_ms);
+    AddField(json, "score", score);
+    json += ",\"principal_variation\":[";
+    for(size_t i = 0; i < principal_variation.size(); i++) {
+      json += (i ? ",\"" : "\"") + principal_variation[i] + "\"";
+    }
+    return json + "]}";
+  }
+
+private:
+  static void AddField(std::string& json, char const* name, double value) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), ",\"%s\":%.6g", name, value);
+    json += buffer;
+  }
+
+  static void AddField(std::string& json, char const* name, uint64_t value) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), ",\"%s\":%llu", name, (unsigned long long)value);
+    json += buffer;
+  }
+
+  static void AddField(std::string& json, char const* name, int value) {
+    AddField(json, name, double(value));
+  }
+};
+
+// Appends search reports to a file as JSON lines. Agents on different
+// threads may share one log.
+class SearchLog {
+public:
+  SearchLog() { }
+
+  SearchLog(SearchLog const&) = delete;
+  SearchLog& operator=(SearchLog const&) = delete;
+
+  ~SearchLog() {
+    Close();
+  }
+
+  // Returns false if path cannot be opened for appending.
+  bool Open(std::string const& path) {
+    Close();
+    file_ = std::fopen(path.c_str(), "a");
+    return file_ != nullptr;
+  }
+
+  void Close() {
+    if(file_) {
+      std::fclose(file_);
+    }
+    file_ = nullptr;
+  }
+
+  void Write(SearchReport const& report) {
+    std::string line = report.ToJson();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(file_) {
+      std::fprintf(file_, "%s\n", line.c_str());
+    }
+  }
+
+private:
+  FILE* file_ = nullptr;
+  std::mutex mutex_;
+};
+
+// Text of an action for reports, through the game's to_string(Action).
+template <class Action>
+std::string ActionString(Action const& action) {
+  using std::to_string;
+  return to_string(action);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include "ConcurrentValueTable.h"
+#include "GameSession.h"
+#include "Parallel.h"
+#include "Random.h"
+#include "TemporalDifferenceAgent.h"
+
+template <class Table, class = void>
+struct HasFull : std::false_type { };
+
+template <class Table>
+struct HasFull<Table, decltype(std::declval<Table const&>().full(), void())>
+  : std::true_type { };
+
+// Trains TemporalDifferenceAgent value tables by self-play on several
+// threads at once. Every thread runs its own game and pair of agents, and
+// all of them learn into the same tables, so ValueTable must tolerate
+// concurrent use unless a single thread is used.
+template <class Game, class ValueTable = ConcurrentValueTable>
+class SelfPlayTrainer {
+public:
+  template <class G>
+  using Agent = TemporalDifferenceAgent<G, ValueTable>;
+
+  SelfPlayTrainer(ValueTable* value_function, ValueTable* terminal_values)
+    : value_function(value_function), terminal_values(terminal_values) { }
+
+  void SetThreadCount(size_t num_threads) {
+    threads = std::max<size_t>(num_threads, 1);
+  }
+
+  void SetLearningRate(float alpha) {
+    this->alpha = alpha;
+  }
+
+  void SetExplorationRate(float epsilon) {
+    this->epsilon = epsilon;
+  }
+
+  // Seeds thread i's ThreadRng with seed + i at the start of every Train.
+  // Thread 0 is the calling thread. With more than one thread the result
+  // still depends on scheduling.
+  void SetSeed(uint64_t seed) {
+    seeded = true;
+    base_seed = seed;
+  }
+
+  // Plays num_games games in total, split evenly across the threads.
+  // Returns false if training stopped early because a table with a full()
+  // check ran out of room; the values learnt until then are kept.
+  bool Train(size_t num_games) {
+    std::atomic<bool> out_of_room(false);
+    ParallelFor(threads, [&](size_t worker) {
+      if(seeded) {
+        SeedThreadRng(base_seed + worker);
+      }
+      Game game;
+      Agent<Game> agent1(value_function, terminal_values);
+      Agent<Game> agent2(value_function, terminal_values);
+      for(Agent<Game>* agent : {&agent1, &agent2}) {
+        agent->SetLearningRate(alpha);
+        agent->SetExplorationRate(epsilon);
+      }
+      GameSession<Game, Agent, Agent> session(game, agent1, agent2);
+      size_t share = num_games / threads + (worker < num_games % threads);
+      for(size_t count = 0; count < share && !out_of_room.load(std::memory_order_relaxed); count++) {
+        session.PlayOnce();
+        if(Full(value_function) || Full(terminal_values)) {
+          out_of_room = true;
+        }
+      }
+    });
+    return !out_of_room;
+  }
+
+private:
+  static bool Full(ValueTable const* table) {
+    if constexpr(HasFull<ValueTable>::value) {
+      return table->full();
+    } else {
+      return false;
+    }
+  }
+
+  ValueTable* value_function;
+  ValueTable* terminal_values;
+  size_t threads = 1;
+  float alpha = 0.05;
+  float epsilon = 0.05;
+  bool seeded = false;
+  uint64_t base_seed = 0;
+};
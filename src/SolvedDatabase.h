@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only table of solved positions backed by a memory-mapped file, so
+// that any number of processes share one page-cached copy and start without
+// solving anything.
+//
+// File layout, all little-endian:
+//   Header            magic, version, flags, game tag, number of entries
+//   uint64_t keys[n]  sorted ascending
+//   uint8_t values[]  2 bits per key, four keys per byte, lowest bits first:
+//                     0 draw, 1 first player wins, 2 first player loses
+//
+// The game tag identifies the game the positions belong to, see GameTag, so
+// that a database of another game is refused rather than answering with
+// unrelated values.
+class SolvedDatabase {
+public:
+  // Keys are Game::GetCanonicalKey() rather than Game::GetStateKey().
+  static const uint32_t kCanonicalKeys = 1;
+
+  SolvedDatabase() { }
+
+  SolvedDatabase(SolvedDatabase const&) = delete;
+  SolvedDatabase& operator=(SolvedDatabase const&) = delete;
+
+  ~SolvedDatabase() {
+    Close();
+  }
+
+  // Fingerprint of a game: the number of actions and the keys along the game
+  // that always takes the first available action. It tells apart the games
+  // and board sizes of this code without them having to name themselves.
+  template <class Game>
+  static uint64_t GameTag() {
+    uint64_t tag = 0xcbf29ce484222325ull;
+    auto mix = [&tag](uint64_t value) {
+      tag = (tag ^ value) * 0x100000001b3ull;
+    };
+    mix(Game::Actions::capacity());
+    Game game;
+    mix(game.GetStateKey());
+    while(!game.GameOver()) {
+      game.ApplyAction(game.GetAvailableActions()[0]);
+      mix(game.GetStateKey());
+    }
+    return tag;
+  }
+
+  // Writes values (+1, 0 or -1 from the first player's point of view) to
+  // path, replacing it atomically so that processes that have the old file
+  // mapped keep reading a complete database. Returns false if the file
+  // cannot be written.
+  template <class Table>
+  static bool Write(std::string const& path, Table const& values, uint32_t flags,
+                    uint64_t game_tag) {
+    std::vector<uint64_t> keys;
+    keys.reserve(values.size());
+    for(auto const& entry : values) {
+      keys.push_back(entry.first);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<uint8_t> packed((keys.size() + 3) / 4, 0);
+    for(size_t i = 0; i < keys.size(); i++) {
+      double value = values.find(keys[i])->second;
+      uint8_t code = value > 0 ? 1 : value < 0 ? 2 : 0;
+      packed[i / 4] |= code << (2 * (i % 4));
+    }
+
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(header.magic));
+    header.version = kVersion;
+    header.flags = flags;
+    header.game_tag = game_tag;
+    header.num_entries = keys.size();
+
+    std::string temp_path = path + ".tmp";
+    FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if(!file) {
+      return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(keys.data(), sizeof(uint64_t), keys.size(), file) == keys.size() &&
+              std::fwrite(packed.data(), 1, packed.size(), file) == packed.size() &&
+              std::fflush(file) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    return ok && std::rename(temp_path.c_str(), path.c_str()) == 0;
+  }
+
+  // Maps path read-only. Returns false, leaving the database closed, if the
+  // file is missing, truncated, not a database of this version or of the
+  // game with game_tag.
+  bool Open(std::string const& path, uint64_t game_tag) {
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+      return false;
+    }
+    struct stat info;
+    if(::fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+      ::close(fd);
+      return false;
+    }
+    void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED) {
+      return false;
+    }
+    mapping_ = mapping;
+    mapping_size_ = info.st_size;
+
+    Header const* header = static_cast<Header const*>(mapping_);
+    uint64_t n = header->num_entries;
+    if(std::memcmp(header->magic, kMagic, sizeof(header->magic)) != 0 ||
+       header->version != kVersion ||
+       header->game_tag != game_tag ||
+       n > (mapping_size_ - sizeof(Header)) / sizeof(uint64_t) ||
+       mapping_size_ < sizeof(Header) + n * sizeof(uint64_t) + (n + 3) / 4) {
+      Close();
+      return false;
+    }
+    flags_ = header->flags;
+    keys_ = reinterpret_cast<uint64_t const*>(header + 1);
+    values_ = reinterpret_cast<uint8_t const*>(keys_ + n);
+    size_ = n;
+    return true;
+  }
+
+  void Close() {
+    if(mapping_) {
+      ::munmap(mapping_, mapping_size_);
+    }
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+    keys_ = nullptr;
+    values_ = nullptr;
+    size_ = 0;
+    flags_ = 0;
+  }
+
+  // Looks key up by binary search and sets value to +1, 0 or -1.
+  bool Find(uint64_t key, double& value) const {
+    uint64_t const* position = std::lower_bound(keys_, keys_ + size_, key);
+    if(position == keys_ + size_ || *position != key) {
+      return false;
+    }
+    size_t i = position - keys_;
+    uint8_t code = (values_[i / 4] >> (2 * (i % 4))) & 3;
+    value = code == 1 ? 1 : code == 2 ? -1 : 0;
+    return true;
+  }
+
+  bool IsOpen() const {
+    return mapping_ != nullptr;
+  }
+
+  uint32_t flags() const {
+    return flags_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+private:
+  static constexpr char kMagic[8] = {'R', 'L', 'S', 'O', 'L', 'V', 'E', 'D'};
+  static const uint32_t kVersion = 2;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t game_tag;
+    uint64_t num_entries;
+  };
+
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  uint64_t const* keys_ = nullptr;
+  uint8_t const* values_ = nullptr;
+  size_t size_ = 0;
+  uint32_t flags_ = 0;
+};
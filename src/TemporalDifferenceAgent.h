@@ -1,20 +1,31 @@
 #pragma once
 
-template <class Game>
+#include <cstdint>
+#include "FlatHashMap.h"
+#include "Random.h"
+#include "ValueCheckpoint.h"
+#include "utils.h"
+
+// ValueTable maps state keys to float values. Its operator[] must insert a
+// zero value for a missing key and return something that converts to float
+// and supports = and +=, and Prefetch(key) must hint an upcoming lookup;
+// ConcurrentValueTable fits when the tables are shared by agents on several
+// threads.
+template <class Game, class ValueTable = FlatHashMap<uint64_t, float>>
 class TemporalDifferenceAgent {
 public:
-    TemporalDifferenceAgent(std::unordered_map<std::string, float>* value_function,
-                            std::unordered_map<std::string, float>* terminal_value_function)
+    TemporalDifferenceAgent(ValueTable* value_function,
+                            ValueTable* terminal_value_function)
      : value_function(value_function), terminal_values(terminal_value_function) { 
      }
 
     TemporalDifferenceAgent()
-     : value_function(new std::unordered_map<std::string, float>()) { }
+     : value_function(new ValueTable()) { }
 
-    void Experience(const std::string &state, 
+    void Experience(uint64_t state,
                     const typename Game::Action& action, 
                     float reward, 
-                    const std::string &next_state,
+                    uint64_t next_state,
                     bool terminal,
                     float td_target) {
 
@@ -25,17 +36,31 @@ public:
             (*terminal_values)[state] = td_target; 
         }
         
-        (*value_function)[state] = state_value + alpha * (td_target - state_value);
+        float new_value = ((*value_function)[state] += alpha * (td_target - state_value));
+
+        if (journal) {
+            if (terminal) {
+                journal->values[next_state] = reward;
+                journal->terminal_values[state] = td_target;
+            }
+            journal->values[state] = new_value;
+        }
     }
 
     typename Game::Action GreedyAction(const Game& state, 
-                                       const std::vector<typename Game::Action>& actions, float& best_value) {
+                                       const typename Game::Actions& actions, float& best_value) {
         best_value = -100.0;
         typename Game::Action best_action;
 
-        for(auto const& action : actions) {
-            Game next_state = state.ForwardModel(action);
-            float state_value = value_sign * GetValue(next_state.GetStateString());
+        uint64_t keys[Game::Actions::capacity()];
+        for(uint32_t i = 0; i < actions.size(); i++) {
+            keys[i] = Key(state.ForwardModel(actions[i]));
+            value_function->Prefetch(keys[i]);
+        }
+
+        for(uint32_t i = 0; i < actions.size(); i++) {
+            auto const& action = actions[i];
+            float state_value = value_sign * GetValue(keys[i]);
             if(state_value >= best_value) {
                 best_value = state_value;
                 best_action = action;
@@ -48,7 +73,7 @@ public:
     void TakeAction(Game& game) {
         typename Game::Action random_action, greedy_action;
         auto actions = game.GetAvailableActions();
-        float random = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+        float random = ThreadRng().UniformFloat();
         bool exploratory = false;
         if(random <= epsilon) {
             random_action = *select_randomly(actions.begin(), actions.end());
@@ -57,9 +82,9 @@ public:
         value_sign = game.FirstPlayersTurn() ? 1.0f : -1.0f;
         float best_value;
         greedy_action = GreedyAction(game, actions, best_value);
-        std::string state = game.GetStateString();
+        uint64_t state = Key(game);
         float reward = game.ApplyAction(exploratory ? random_action : greedy_action);
-        std::string next_state = game.GetStateString();
+        uint64_t next_state = Key(game);
         Experience(state, greedy_action, reward, next_state, game.GameOver(), best_value);
     }
 
@@ -75,6 +100,18 @@ public:
 
     }
 
+    // Keys the value tables by Game::GetCanonicalKey(), so symmetric
+    // positions share one value and learn from each other's experience.
+    void SetUseSymmetry(bool enabled) {
+        use_symmetry = enabled;
+    }
+
+    // Records every table update in journal as well, so that a training run
+    // can ValueCheckpoint::Append its progress. Pass nullptr to stop.
+    void SetJournal(ValueJournal* journal) {
+        this->journal = journal;
+    }
+
     void Maximize() {
         value_sign = 1.0;
     }
@@ -83,20 +120,22 @@ public:
         value_sign = -1.0;
     }
 
-    std::unordered_map<std::string, float>* terminal_values;
+    ValueTable* terminal_values;
 
 private:
-    float GetValue(const std::string &state_string) {
-        if(value_function->find(state_string) == value_function->end()) {
-            (*value_function)[state_string] = 0.0;
-            return 0.0;
-        }
-        return (*value_function)[state_string];
+    uint64_t Key(const Game& state) const {
+        return use_symmetry ? state.GetCanonicalKey() : state.GetStateKey();
+    }
+
+    float GetValue(uint64_t state_key) {
+        return (*value_function)[state_key];
     }
 
     float value_sign = 1.0;
+    bool use_symmetry = false;
     float alpha = 0.05; //learning rate
     float epsilon = 0.05; //exploration rate
-    std::unordered_map<std::string, float>* value_function;
+    ValueTable* value_function;
+    ValueJournal* journal = nullptr;
 
 };
\ No newline at end of file
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <Eigen/Dense>
 
+#include "ActionList.h"
+
 //     A      our turn
 //   B   C    their turn
 // D  E F  G  our turn
@@ -31,6 +34,7 @@ class TestGame {
 public:
     using Action = int;
     using Status = TestGameStatus;
+    using Actions = ActionList<int, 2>;
     using BoardStateType = std::string;
 
     TestGame() {
@@ -38,73 +42,29 @@ public:
     };
 
     BoardStateType GetBoardState() const {
-        return current_node_.state;
+        return current_node_->state;
     }
 
     void Reset() {
         game_status_ = TestGameStatus::IN_PROGRESS;
-
-        TestGameNode node_D;
-        node_D.state = "D";
-        node_D.status = TestGameStatus::LOSS;
-
-        TestGameNode node_F;
-        node_F.state = "F";
-        node_F.status = TestGameStatus::LOSS;
-
-        TestGameNode node_G;
-        node_G.state = "G";
-        node_G.status = TestGameStatus::LOSS;
-
-        TestGameNode node_H;
-        node_H.state = "H";
-        node_H.status = TestGameStatus::WIN;
-
-        TestGameNode node_E;
-        node_E.state = "E";
-        node_E.status = TestGameStatus::IN_PROGRESS;
-        node_E.children.push_back(node_H);
-
-        TestGameNode node_B;
-        node_B.state = "B";
-        node_B.status = TestGameStatus::IN_PROGRESS;
-        node_B.children.push_back(node_D);
-        node_B.children.push_back(node_E);
-
-        TestGameNode node_C;
-        node_C.state = "C";
-        node_C.status = TestGameStatus::IN_PROGRESS;
-        node_C.children.push_back(node_F);
-        node_C.children.push_back(node_G);
-
-        root_.children.clear();
-
-        root_.state = "A";
-        root_.status = TestGameStatus::IN_PROGRESS;
-        root_.children.push_back(node_B);
-        root_.children.push_back(node_C);
-
-        current_node_ = root_;
+        current_node_ = &Root();
     }
 
-    std::vector<Action> GetAvailableActions() const {
-        std::vector<Action> actions;
+    Actions GetAvailableActions() const {
+        Actions actions;
         if(GameOver()) {
           return actions;
         }
 
-        for(int i = 0; i < current_node_.children.size(); i++) {
+        for(int i = 0; i < current_node_->children.size(); i++) {
           actions.push_back(i);
         }
         return actions;
     }
 
     void ApplyAction(Action const& action) {
-        std::cout << "trying to apply action " << action << " from state " << GetStateString() << std::endl;
-        auto selected_child = current_node_.children[action];
-        std::cout << "selected child is: " << selected_child.state << std::endl;
-        current_node_ = selected_child;
-        game_status_ = current_node_.status;
+        current_node_ = &current_node_->children[action];
+        game_status_ = current_node_->status;
     }
 
     TestGame ForwardModel(Action const& action) const {
@@ -130,11 +90,86 @@ public:
     }
 
     std::string GetStateString() const {
-        return current_node_.state;
+        return current_node_->state;
+    }
+
+    int MovePriority(Action const& /*action*/) const {
+        return 0;
     }
 
+    uint64_t GetStateKey() const {
+        return static_cast<unsigned char>(current_node_->state[0]);
+    }
+
+    // The tree has no symmetries.
+    uint64_t GetCanonicalKey() const {
+        return GetStateKey();
+    }
+
+    int GetCanonicalSymmetry() const {
+        return 0;
+    }
+
+    static Action TransformAction(Action const& action, int /*symmetry*/) {
+        return action;
+    }
+
+    static Action InverseTransformAction(Action const& action, int /*symmetry*/) {
+        return action;
+    }
+
+    static constexpr int num_symmetries = 1;
+
 private:
+    // The tree is built once and shared by every game, so copying a game or
+    // applying an action only moves a pointer.
+    static TestGameNode const& Root() {
+        static TestGameNode const root = BuildTree();
+        return root;
+    }
+
+    static TestGameNode BuildTree() {
+        TestGameNode node_D;
+        node_D.state = "D";
+        node_D.status = TestGameStatus::LOSS;
+
+        TestGameNode node_F;
+        node_F.state = "F";
+        node_F.status = TestGameStatus::LOSS;
+
+        TestGameNode node_G;
+        node_G.state = "G";
+        node_G.status = TestGameStatus::LOSS;
+
+        TestGameNode node_H;
+        node_H.state = "H";
+        node_H.status = TestGameStatus::WIN;
+
+        TestGameNode node_E;
+        node_E.state = "E";
+        node_E.status = TestGameStatus::IN_PROGRESS;
+        node_E.children.push_back(node_H);
+
+        TestGameNode node_B;
+        node_B.state = "B";
+        node_B.status = TestGameStatus::IN_PROGRESS;
+        node_B.children.push_back(node_D);
+        node_B.children.push_back(node_E);
+
+        TestGameNode node_C;
+        node_C.state = "C";
+        node_C.status = TestGameStatus::IN_PROGRESS;
+        node_C.children.push_back(node_F);
+        node_C.children.push_back(node_G);
+
+        TestGameNode root;
+        root.state = "A";
+        root.status = TestGameStatus::IN_PROGRESS;
+        root.children.push_back(node_B);
+        root.children.push_back(node_C);
+        return root;
+    }
+
     TestGameStatus game_status_;
-    TestGameNode current_node_;
-    TestGameNode root_;
+    TestGameNode const* current_node_;
 };
\ No newline at end of file
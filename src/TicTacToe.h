@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
-#include <vector>
 #include <Eigen/Dense>
 
+#include "ActionList.h"
+
 enum class TicTacToeStatus {
     X_WINS,
     O_WINS,
@@ -54,19 +57,107 @@ std::string to_string(TicTacToeAction const& action) {
            + std::to_string(action.column_index) + "}";
 }
 
+// Cells are numbered row-major, so cell = 3 * row_index + column_index.
+constexpr unsigned kTicTacToeLines[] = {
+    0x007, 0x038, 0x1C0,  // rows
+    0x049, 0x092, 0x124,  // columns
+    0x111, 0x054          // diagonals
+};
+
+// One bit per 9-bit occupancy mask, set when the mask contains a full line.
+struct TicTacToeWinTable {
+    uint64_t bits[8];
+
+    constexpr bool operator[](unsigned mask) const {
+        return (bits[mask >> 6] >> (mask & 63)) & 1;
+    }
+};
+
+constexpr TicTacToeWinTable MakeTicTacToeWinTable() {
+    TicTacToeWinTable table{};
+    for(unsigned mask = 0; mask < 512; mask++) {
+        for(unsigned line : kTicTacToeLines) {
+            if((mask & line) == line) {
+                table.bits[mask >> 6] |= uint64_t(1) << (mask & 63);
+                break;
+            }
+        }
+    }
+    return table;
+}
+
+constexpr TicTacToeWinTable kTicTacToeWins = MakeTicTacToeWinTable();
+
+// The eight symmetries of the board: rotations by 0, 90, 180 and 270
+// degrees, then reflections in the vertical axis, the horizontal axis, the
+// main diagonal and the anti-diagonal. Maps a cell to its image.
+constexpr int TicTacToeSymmetricCell(int symmetry, int cell) {
+    int row = cell / 3, col = cell % 3;
+    switch(symmetry) {
+        case 1: return col * 3 + (2 - row);
+        case 2: return (2 - row) * 3 + (2 - col);
+        case 3: return (2 - col) * 3 + row;
+        case 4: return row * 3 + (2 - col);
+        case 5: return (2 - row) * 3 + col;
+        case 6: return col * 3 + row;
+        case 7: return (2 - col) * 3 + (2 - row);
+    }
+    return cell;
+}
+
+constexpr int kTicTacToeInverseSymmetry[8] = {0, 3, 2, 1, 4, 5, 6, 7};
+
+// Image of every 9-bit occupancy mask under every symmetry.
+struct TicTacToeSymmetryTable {
+    uint16_t masks[8][512];
+};
+
+constexpr TicTacToeSymmetryTable MakeTicTacToeSymmetryTable() {
+    TicTacToeSymmetryTable table{};
+    for(int symmetry = 0; symmetry < 8; symmetry++) {
+        for(unsigned mask = 0; mask < 512; mask++) {
+            for(int cell = 0; cell < 9; cell++) {
+                if(mask & (1u << cell)) {
+                    table.masks[symmetry][mask] |= 1u << TicTacToeSymmetricCell(symmetry, cell);
+                }
+            }
+        }
+    }
+    return table;
+}
+
+constexpr TicTacToeSymmetryTable kTicTacToeSymmetries = MakeTicTacToeSymmetryTable();
+
 class TicTacToe {
 public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     using Action = TicTacToeAction;
     using Status = TicTacToeStatus;
+    using Actions = ActionList<TicTacToeAction, 9>;
     using BoardStateType = Eigen::Matrix<char, 3, 3>;
 
     TicTacToe(std::string const& state) {
+        Reset();
+        for(int row_index = 0; row_index < size; row_index++) {
+            for(int column_index = 0; column_index < size; column_index++) {
+                // Eigen storage is column major.
+                char cell = state[column_index * size + row_index];
+                if(cell == 'x') {
+                    x_mask_ |= CellBit(row_index, column_index);
+                } else if(cell == 'o') {
+                    o_mask_ |= CellBit(row_index, column_index);
+                }
+            }
+        }
         size_t num_x = std::count(state.begin(), state.end(), 'x');
         size_t num_o = std::count(state.begin(), state.end(), 'o');
         x_turn = !(num_x == num_o + 1);
-        memcpy(board_state_.data(), state.c_str(), 9);
-        game_status_ = UpdateTicTacToeStatus();
+        if(kTicTacToeWins[x_mask_]) {
+            game_status_ = TicTacToeStatus::X_WINS;
+        } else if(kTicTacToeWins[o_mask_]) {
+            game_status_ = TicTacToeStatus::O_WINS;
+        } else if((x_mask_ | o_mask_) == full_mask) {
+            game_status_ = TicTacToeStatus::DRAW;
+        }
     }
 
     TicTacToe() {
@@ -74,7 +165,21 @@ public:
     };
 
     BoardStateType GetBoardState() const {
-        return board_state_;
+        BoardStateType board_state;
+        for(int row_index = 0; row_index < size; row_index++) {
+            for(int column_index = 0; column_index < size; column_index++) {
+                board_state(row_index, column_index) = GetCell(row_index, column_index);
+            }
+        }
+        return board_state;
+    }
+
+    char GetCell(int row_index, int column_index) const {
+        unsigned bit = CellBit(row_index, column_index);
+        if(x_mask_ & bit) {
+            return 'x';
+        }
+        return (o_mask_ & bit) ? 'o' : '-';
     }
 
     float GetReward() const {
@@ -90,29 +195,53 @@ public:
 
     void Reset() {
         game_status_ = TicTacToeStatus::IN_PROGRESS;
-        board_state_.fill('-');
+        x_mask_ = 0;
+        o_mask_ = 0;
         x_turn = true;
     }
 
-    std::vector<TicTacToeAction> GetAvailableActions() const {
-        std::vector<TicTacToeAction> actions;
-        if(GameOver()) {
-          return actions;
-        }
-        for(int row_index = 0; row_index < size; row_index++) {
-            for(int column_index = 0; column_index < size; column_index++) {
-                if(board_state_(row_index, column_index) == '-') {
-                    actions.push_back({row_index, column_index});
-                }
-            }
+    Actions GetAvailableActions() const {
+        Actions actions;
+        unsigned legal = GetLegalMoveMask();
+        for(; legal; legal &= legal - 1) {
+            int cell = __builtin_ctz(legal);
+            actions.push_back({cell / size, cell % size});
         }
         return actions;
     }
 
+    // Search-order hint: the centre lies on four lines, corners on three and
+    // edges on two.
+    int MovePriority(TicTacToeAction const& action) const {
+        int lines = 0;
+        for(unsigned line : kTicTacToeLines) {
+            lines += (line >> (action.row_index * size + action.column_index)) & 1;
+        }
+        return lines;
+    }
+
+    // Bit 3 * row_index + column_index is set when that cell is playable.
+    unsigned GetLegalMoveMask() const {
+        return GameOver() ? 0 : ~(x_mask_ | o_mask_) & full_mask;
+    }
+
     float ApplyAction(TicTacToeAction const& action) {
-        board_state_(action.row_index, action.column_index) = x_turn ? 'x' : 'o';
+        unsigned bit = CellBit(action.row_index, action.column_index);
+        if(x_turn) {
+            x_mask_ |= bit;
+            if(kTicTacToeWins[x_mask_]) {
+                game_status_ = TicTacToeStatus::X_WINS;
+            }
+        } else {
+            o_mask_ |= bit;
+            if(kTicTacToeWins[o_mask_]) {
+                game_status_ = TicTacToeStatus::O_WINS;
+            }
+        }
+        if(game_status_ == TicTacToeStatus::IN_PROGRESS && (x_mask_ | o_mask_) == full_mask) {
+            game_status_ = TicTacToeStatus::DRAW;
+        }
         x_turn = !x_turn;
-        game_status_ = UpdateTicTacToeStatus();
         return GetReward();
     }
 
@@ -135,91 +264,69 @@ public:
     }
 
     std::string GetStateString() const {
-        return std::string(board_state_.data(), string_size);
-    }
-
-private:
-
-    TicTacToeStatus UpdateTicTacToeStatus() {
+        std::string state(string_size, '-');
         for(int row_index = 0; row_index < size; row_index++) {
-            if(CheckRowValue(row_index, 'o')) {
-                return TicTacToeStatus::O_WINS;
-            } else if(CheckRowValue(row_index, 'x')) {
-                return TicTacToeStatus::X_WINS;
-            }
-        }
-
-        for(int column_index = 0; column_index < size; column_index++) {
-            if(CheckColumnValue(column_index, 'o')) {
-                return TicTacToeStatus::O_WINS;
-            } else if(CheckColumnValue(column_index, 'x')) {
-                return TicTacToeStatus::X_WINS;
+            for(int column_index = 0; column_index < size; column_index++) {
+                state[column_index * size + row_index] = GetCell(row_index, column_index);
             }
         }
+        return state;
+    }
 
-        if(CheckFirstDiagonal('x') || CheckSecondDiagonal('x')) {
-            return TicTacToeStatus::X_WINS;
-        } else if(CheckFirstDiagonal('o') || CheckSecondDiagonal('o')) {
-            return TicTacToeStatus::O_WINS;
-        }
-
-        if(BoardFull()) {
-            return TicTacToeStatus::DRAW;
-        }
+    // Perfect 18-bit encoding of the position: x cells in the low nine bits,
+    // o cells in the high nine.
+    uint64_t GetStateKey() const {
+        return x_mask_ | (uint64_t(o_mask_) << 9);
+    }
 
-        return TicTacToeStatus::IN_PROGRESS;
+    // Smallest GetStateKey() over the eight symmetric images of the
+    // position, so that all of them share one table entry.
+    uint64_t GetCanonicalKey() const {
+        return SymmetricKey(GetCanonicalSymmetry());
     }
 
-    bool CheckFirstDiagonal(char value) const {
-        for(int index = 0; index < size; index++) {
-            if(board_state_(index, index) != value) {
-                return false;
+    // Symmetry that takes this position to its canonical image.
+    int GetCanonicalSymmetry() const {
+        int best = 0;
+        uint64_t best_key = GetStateKey();
+        for(int symmetry = 1; symmetry < num_symmetries; symmetry++) {
+            uint64_t key = SymmetricKey(symmetry);
+            if(key < best_key) {
+                best_key = key;
+                best = symmetry;
             }
         }
-        return true;
+        return best;
     }
 
-    bool CheckSecondDiagonal(char value) const {
-        for(int index = 0; index < size; index++) {
-            if(board_state_(size - index - 1, index) != value) {
-                return false;
-            }
-        }
-        return true;
+    // Maps an action on this position to the matching action on its image
+    // under symmetry, and back.
+    static TicTacToeAction TransformAction(TicTacToeAction const& action, int symmetry) {
+        int cell = TicTacToeSymmetricCell(symmetry, action.row_index * size + action.column_index);
+        return {cell / size, cell % size};
     }
 
-    bool CheckRowValue(size_t row_index, char value) const {
-        for(int column_index = 0; column_index < size; column_index++) {
-            if(board_state_(row_index, column_index) != value) {
-                return false;
-            }
-        }
-        return true;
+    static TicTacToeAction InverseTransformAction(TicTacToeAction const& action, int symmetry) {
+        return TransformAction(action, kTicTacToeInverseSymmetry[symmetry]);
     }
 
-    bool CheckColumnValue(size_t column_index, char value) const {
-        for(int row_index = 0; row_index < size; row_index++) {
-            if(board_state_(row_index, column_index) != value) {
-                return false;
-            }
-        }
-        return true;
+    static constexpr int num_symmetries = 8;
+
+private:
+    uint64_t SymmetricKey(int symmetry) const {
+        return kTicTacToeSymmetries.masks[symmetry][x_mask_] |
+               (uint64_t(kTicTacToeSymmetries.masks[symmetry][o_mask_]) << 9);
     }
 
-    bool BoardFull() const {
-        for(int row_index = 0; row_index < size; row_index++) {
-            for(int column_index = 0; column_index < size; column_index++) {
-                if(board_state_(row_index, column_index) == '-') {
-                    return false;
-                }
-            }
-        }
-        return true;
+    static unsigned CellBit(int row_index, int column_index) {
+        return 1u << (row_index * size + column_index);
     }
 
-    BoardStateType board_state_;
+    uint16_t x_mask_;
+    uint16_t o_mask_;
     TicTacToeStatus game_status_;
-    const int size = 3;
-    const int string_size = size * size;
     bool x_turn;
-};
\ No newline at end of file
+    static constexpr int size = 3;
+    static constexpr int string_size = size * size;
+    static constexpr unsigned full_mask = 0x1FF;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Parallel.h"
+
+enum class Bound : uint8_t {
+  NONE,
+  EXACT,
+  LOWER,
+  UPPER
+};
+
+// Result of an earlier search of a position. best_move is an index into the
+// position's GetAvailableActions() list. horizon records whether the score
+// depended on the static evaluation anywhere below.
+struct TTEntry {
+  int score;
+  int depth;
+  Bound bound;
+  int best_move;
+  bool horizon;
+};
+
+// Fixed-size, direct-mapped transposition table for alpha-beta search that
+// can be shared by concurrent searches without locks. Each slot holds the
+// entry packed into 64 bits and the key XOR-ed with it; a probe only accepts
+// a slot whose two words still XOR to its key, so a slot torn by racing
+// writers reads as a miss instead of as another position's entry. A slot is
+// replaced when it belongs to an older search or the new result is at least
+// as deep, with exact scores winning ties.
+class TranspositionTable {
+public:
+  explicit TranspositionTable(size_t num_entries = 1 << 20)
+    : age_(0) {
+    Resize(num_entries);
+  }
+
+  // Rounds num_entries down to a power of two.
+  void Resize(size_t num_entries) {
+    size_t size = 1;
+    while(size * 2 <= num_entries) {
+      size *= 2;
+    }
+    slots_.assign(size, Slot());
+    mask_ = size - 1;
+  }
+
+  void Clear() {
+    slots_.assign(slots_.size(), Slot());
+  }
+
+  // Marks the start of a new search, so entries of earlier searches become
+  // the first to be replaced. Must not race with Store.
+  void NewSearch() {
+    age_++;
+  }
+
+  bool Probe(uint64_t key, TTEntry& entry) const {
+    Slot const& slot = slots_[Index(key)];
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    uint64_t key_xor_data = slot.key_xor_data.load(std::memory_order_relaxed);
+    if(data == 0 || (key_xor_data ^ data) != key) {
+      return false;
+    }
+    entry = Unpack(data);
+    return true;
+  }
+
+  void Store(uint64_t key, TTEntry const& entry) {
+    Slot& slot = slots_[Index(key)];
+    uint64_t old_data = slot.data.load(std::memory_order_relaxed);
+    if(old_data != 0 && AgeOf(old_data) == age_) {
+      TTEntry old = Unpack(old_data);
+      if(old.depth > entry.depth ||
+         (old.depth == entry.depth && old.bound == Bound::EXACT &&
+          entry.bound != Bound::EXACT)) {
+        return;
+      }
+    }
+    uint64_t data = Pack(entry);
+    slot.key_xor_data.store(key ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+  }
+
+  size_t size() const {
+    return slots_.size();
+  }
+
+  size_t BytesUsed() const {
+    return slots_.size() * sizeof(Slot);
+  }
+
+private:
+  struct Slot {
+    CopyableAtomic<uint64_t> key_xor_data;
+    CopyableAtomic<uint64_t> data;
+  };
+
+  // Layout: score (16) | depth (8) | bound (2) | horizon (1) | best_move (8) | age (8).
+  // A zero word is an empty slot, which Bound::NONE guarantees never to
+  // collide with a real entry.
+  uint64_t Pack(TTEntry const& entry) const {
+    return uint64_t(uint16_t(int16_t(entry.score))) |
+           uint64_t(uint8_t(entry.depth)) << 16 |
+           uint64_t(entry.bound) << 24 |
+           uint64_t(entry.horizon) << 26 |
+           uint64_t(uint8_t(entry.best_move)) << 32 |
+           uint64_t(age_) << 40;
+  }
+
+  static TTEntry Unpack(uint64_t data) {
+    TTEntry entry;
+    entry.score = int16_t(data & 0xFFFF);
+    entry.depth = (data >> 16) & 0xFF;
+    entry.bound = Bound((data >> 24) & 0x3);
+    entry.horizon = (data >> 26) & 0x1;
+    entry.best_move = (data >> 32) & 0xFF;
+    return entry;
+  }
+
+  static uint8_t AgeOf(uint64_t data) {
+    return data >> 40;
+  }
+
+  size_t Index(uint64_t key) const {
+    return (key * 0x9E3779B97F4A7C15ull) >> 20 & mask_;
+  }
+
+  std::vector<Slot> slots_;
+  size_t mask_;
+  uint8_t age_;
+};
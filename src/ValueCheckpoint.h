@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "FlatHashMap.h"
+
+// Entries written to the value tables since the journal was last cleared,
+// for ValueCheckpoint::Append.
+struct ValueJournal {
+  FlatHashMap<uint64_t, float> values;
+  FlatHashMap<uint64_t, float> terminal_values;
+
+  bool empty() const {
+    return values.empty() && terminal_values.empty();
+  }
+
+  void clear() {
+    values.clear();
+    terminal_values.clear();
+  }
+};
+
+// Binary checkpoints of TemporalDifferenceAgent value tables.
+//
+// A file is a header followed by chunks. Each chunk holds entries for one of
+// the two tables, either as raw keys or as sorted keys stored as LEB128
+// deltas, followed by the float values. Loading replays the chunks in
+// order, so chunks appended later override earlier entries and a long
+// training run can journal its updates cheaply instead of rewriting the
+// whole table.
+class ValueCheckpoint {
+public:
+  // Writes a full snapshot of both tables, replacing path atomically. A
+  // table is anything that iterates as (key, value) pairs.
+  template <class ValueTable>
+  static bool Save(std::string const& path,
+                   ValueTable const& values,
+                   ValueTable const& terminal_values,
+                   bool compress = true) {
+    std::string temp_path = path + ".tmp";
+    FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if(!file) {
+      return false;
+    }
+    bool ok = WriteHeader(file) &&
+              WriteChunk(file, kValues, values, compress) &&
+              WriteChunk(file, kTerminalValues, terminal_values, compress);
+    ok = std::fclose(file) == 0 && ok;
+    return ok && std::rename(temp_path.c_str(), path.c_str()) == 0;
+  }
+
+  // Appends the journalled entries to path, creating it if needed.
+  static bool Append(std::string const& path, ValueJournal const& journal,
+                     bool compress = true) {
+    FILE* file = std::fopen(path.c_str(), "ab");
+    if(!file) {
+      return false;
+    }
+    bool ok = true;
+    if(std::ftell(file) == 0) {
+      ok = WriteHeader(file);
+    }
+    if(ok && !journal.values.empty()) {
+      ok = WriteChunk(file, kValues, journal.values, compress);
+    }
+    if(ok && !journal.terminal_values.empty()) {
+      ok = WriteChunk(file, kTerminalValues, journal.terminal_values, compress);
+    }
+    return std::fclose(file) == 0 && ok;
+  }
+
+  // Adds the entries in path to the tables. A truncated final chunk, as
+  // left by an interrupted Append, is ignored. Returns false, leaving the
+  // tables untouched, if the file is missing, not a checkpoint of this
+  // version or has a corrupt chunk. The entries are staged and only added
+  // once the whole file has been read.
+  template <class ValueTable>
+  static bool Load(std::string const& path,
+                   ValueTable* values,
+                   ValueTable* terminal_values) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if(!file) {
+      return false;
+    }
+    long file_size = -1;
+    if(std::fseek(file, 0, SEEK_END) == 0) {
+      file_size = std::ftell(file);
+    }
+    Header header;
+    if(file_size < 0 || std::fseek(file, 0, SEEK_SET) != 0 ||
+       std::fread(&header, sizeof(header), 1, file) != 1 ||
+       std::memcmp(header.magic, kMagic, sizeof(header.magic)) != 0 ||
+       header.version != kVersion) {
+      std::fclose(file);
+      return false;
+    }
+
+    bool ok = true;
+    FlatHashMap<uint64_t, float> staged[2];
+    std::vector<uint8_t> payload;
+    ChunkHeader chunk;
+    while(ok && std::fread(&chunk, sizeof(chunk), 1, file) == 1) {
+      // A payload running past the end of the file is a truncated chunk.
+      long position = std::ftell(file);
+      if(position < 0 || chunk.payload_size > uint64_t(file_size - position)) {
+        break;
+      }
+      payload.resize(chunk.payload_size);
+      if(std::fread(payload.data(), 1, payload.size(), file) != payload.size()) {
+        break;
+      }
+      ok = chunk.table <= kTerminalValues && chunk.encoding <= kDeltaVarint &&
+           ReadChunk(chunk, payload, &staged[chunk.table]);
+    }
+    std::fclose(file);
+    if(!ok) {
+      return false;
+    }
+    for(auto const& entry : staged[kValues]) {
+      (*values)[entry.first] = entry.second;
+    }
+    for(auto const& entry : staged[kTerminalValues]) {
+      (*terminal_values)[entry.first] = entry.second;
+    }
+    return true;
+  }
+
+private:
+  static constexpr char kMagic[8] = {'R', 'L', 'V', 'A', 'L', 'U', 'E', 0};
+  static const uint32_t kVersion = 1;
+
+  enum : uint8_t { kValues, kTerminalValues };
+  enum : uint8_t { kRaw, kDeltaVarint };
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+  };
+
+  struct ChunkHeader {
+    uint8_t table;
+    uint8_t encoding;
+    uint16_t reserved;
+    uint32_t count;
+    uint64_t payload_size;
+  };
+
+  static bool WriteHeader(FILE* file) {
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(header.magic));
+    header.version = kVersion;
+    header.flags = 0;
+    return std::fwrite(&header, sizeof(header), 1, file) == 1;
+  }
+
+  template <class ValueTable>
+  static bool WriteChunk(FILE* file, uint8_t table,
+                         ValueTable const& entries,
+                         bool compress) {
+    std::vector<std::pair<uint64_t, float>> sorted;
+    sorted.reserve(entries.size());
+    for(auto const& entry : entries) {
+      sorted.emplace_back(entry.first, entry.second);
+    }
+    if(compress) {
+      std::sort(sorted.begin(), sorted.end());
+    }
+
+    std::vector<uint8_t> payload;
+    payload.reserve(sorted.size() * (compress ? 8 : 12));
+    uint64_t previous = 0;
+    for(auto const& entry : sorted) {
+      if(compress) {
+        uint64_t delta = entry.first - previous;
+        previous = entry.first;
+        for(; delta >= 0x80; delta >>= 7) {
+          payload.push_back(uint8_t(delta) | 0x80);
+        }
+        payload.push_back(uint8_t(delta));
+      } else {
+        Put(payload, entry.first);
+      }
+    }
+    for(auto const& entry : sorted) {
+      Put(payload, entry.second);
+    }
+
+    ChunkHeader chunk;
+    chunk.table = table;
+    chunk.encoding = compress ? kDeltaVarint : kRaw;
+    chunk.reserved = 0;
+    chunk.count = sorted.size();
+    chunk.payload_size = payload.size();
+    return std::fwrite(&chunk, sizeof(chunk), 1, file) == 1 &&
+           std::fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+  }
+
+  template <class ValueTable>
+  static bool ReadChunk(ChunkHeader const& chunk, std::vector<uint8_t> const& payload,
+                        ValueTable* table) {
+    size_t values_size = size_t(chunk.count) * sizeof(float);
+    if(payload.size() < values_size) {
+      return false;
+    }
+    uint8_t const* keys = payload.data();
+    uint8_t const* keys_end = payload.data() + payload.size() - values_size;
+    uint8_t const* values = keys_end;
+
+    uint64_t key = 0;
+    for(uint32_t i = 0; i < chunk.count; i++) {
+      if(chunk.encoding == kDeltaVarint) {
+        uint64_t delta = 0;
+        int shift = 0;
+        do {
+          if(keys == keys_end || shift > 63) {
+            return false;
+          }
+          delta |= uint64_t(*keys & 0x7F) << shift;
+          shift += 7;
+        } while(*keys++ & 0x80);
+        key += delta;
+      } else {
+        if(keys_end - keys < 8) {
+          return false;
+        }
+        std::memcpy(&key, keys, sizeof(key));
+        keys += sizeof(key);
+      }
+      // The all-ones key marks empty slots in the tables and is never saved.
+      if(key == ~uint64_t(0)) {
+        return false;
+      }
+      float value;
+      std::memcpy(&value, values + i * sizeof(float), sizeof(value));
+      (*table)[key] = value;
+    }
+    return keys == keys_end;
+  }
+
+  template <class T>
+  static void Put(std::vector<uint8_t>& payload, T value) {
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    payload.insert(payload.end(), bytes, bytes + sizeof(T));
+  }
+};
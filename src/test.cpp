@@ -1,76 +1,80 @@
+#include <cstdlib>
+#include <algorithm>
 #include <iostream>
-#include <unordered_map>
+#include <thread>
 
 #include "GameSession.h"
+#include "MatchRunner.h"
 #include "TicTacToe.h"
 #include "PickRandomActionAgent.h"
 #include "MinimaxAgent.h"
 #include "TemporalDifferenceAgent.h"
+#include "SelfPlayTrainer.h"
 #include "MonteCarloTreeSearchAgent.h"
 #include "TestGame.h"
-#include "Stopwatch.h"
+#include "Random.h"
+#include "ValueCheckpoint.h"
 
+// usage: tictactoe [seed] [checkpoint]
+// With a checkpoint path the TD tables are loaded from it if it exists, and
+// trained and saved to it otherwise.
 int main(int argc, char* argv[])  {
-    std::srand ( unsigned ( std::time(0) ) );
+    uint64_t seed = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+    SeedThreadRng(seed);
+    std::cout << "seed: " << seed << std::endl;
 
-    int x_wins=0, o_wins=0, draws=0;
     int num_games = 1000;
-    TicTacToe game;
-    std::unordered_map<std::string, float> value_function, terminal_values;
-    TemporalDifferenceAgent<TicTacToe> agent1(&value_function, &terminal_values);
-    TemporalDifferenceAgent<TicTacToe> agent2(&value_function, &terminal_values);
-    GameSession<TicTacToe, TemporalDifferenceAgent, TemporalDifferenceAgent> 
-    training_session(game, agent1, agent2);
+    ConcurrentValueTable value_function, terminal_values;
+    SelfPlayTrainer<TicTacToe> trainer(&value_function, &terminal_values);
 
     int training_games = 50000;
 
-    agent1.SetExplorationRate(1.0);
-    agent2.SetExplorationRate(1.0);
+    trainer.SetExplorationRate(1.0);
+    trainer.SetLearningRate(1);
+    trainer.SetSeed(seed);
+    trainer.SetThreadCount(std::max(1u, std::thread::hardware_concurrency()));
 
-    agent1.SetLearningRate(1);
-    agent2.SetLearningRate(1);
-
-    training_session.PlayN(training_games);
+    char const* checkpoint = argc > 2 ? argv[2] : nullptr;
+    if(checkpoint && ValueCheckpoint::Load(checkpoint, &value_function, &terminal_values)) {
+        std::cout << "loaded " << value_function.size() << " values from " << checkpoint << std::endl;
+    } else {
+        if(!trainer.Train(training_games)) {
+            std::cerr << "value table full after " << value_function.size() << " entries" << std::endl;
+        }
+        if(checkpoint && !ValueCheckpoint::Save(checkpoint, value_function, terminal_values)) {
+            std::cerr << "could not write " << checkpoint << std::endl;
+        }
+    }
   
-    Stopwatch sw;
     MinimaxAgent<TicTacToe> god;
     MonteCarloTreeSearchAgent<TicTacToe> mcts;
-    GameSession<TicTacToe, MinimaxAgent, MonteCarloTreeSearchAgent>
-    session(game, god, mcts);
-
-   agent1.SetExplorationRate(0);
-   agent2.SetExplorationRate(0);
+    MatchRunner<TicTacToe, MinimaxAgent, MonteCarloTreeSearchAgent> match(god, mcts);
+    match.SetSeed(seed);
+    match.SetThreadCount(std::max(1u, std::thread::hardware_concurrency()));
 
-   sw.Start();
-   for(int i = 0; i < num_games ; i++) {
-       switch(session.PlayOnce()) {
-       case TicTacToeStatus::X_WINS:
-           x_wins++;
-           break;
-       case TicTacToeStatus::O_WINS:
-           o_wins++;
-           break;
-       case TicTacToeStatus::DRAW:
-           draws++;
-           break;
-       }
-       session.Reset();
-   }
-   sw.Stop();
+   MatchResults results = match.Play(num_games);
 
    std::cout << "Played "
-   << num_games/sw.ElapsedMillis()*1000
+   << results.GamesPerSecond()
    << " games per second." << std::endl;
 
    std::cout << "x_wins: "
-   << x_wins/(float)num_games*100
+   << results.Player1WinRate()*100
    << std::endl;
 
    std::cout << "o_wins: "
-   << o_wins/(float)num_games*100
+   << results.Player2WinRate()*100
    << std::endl;
 
    std::cout << "draws: "
-   << draws/(float)num_games*100
+   << results.DrawRate()*100
    << std::endl;
+
+   for(int player = 0; player < 2; player++) {
+       LogHistogram const& times = results.move_nanos[player];
+       std::cout << (player == 0 ? "x" : "o") << " move time us (p50/p99/max): "
+       << times.Quantile(0.5)/1000.0 << " / "
+       << times.Quantile(0.99)/1000.0 << " / "
+       << times.Max()/1000.0 << std::endl;
+   }
 }
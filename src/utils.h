@@ -1,17 +1,15 @@
 #pragma once
 
+#include <iterator>
+#include "Random.h"
+
 template<typename Iter, typename RandomGenerator>
 inline Iter select_randomly(Iter start, Iter end, RandomGenerator& g) {
-    std::uniform_int_distribution<> dis(0, std::distance(start, end) - 1);
-    std::advance(start, dis(g));
+    std::advance(start, RandomIndex(std::distance(start, end), g));
     return start;
 }
 
 template<typename Iter>
 inline Iter select_randomly(Iter start, Iter end) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    Iter choice = select_randomly(start, end, gen);
-    // std::cout << std::distance(start, choice) << "/" << std::distance(start, end) << std::endl;
-    return choice;
-}
\ No newline at end of file
+    return select_randomly(start, end, ThreadRng());
+}
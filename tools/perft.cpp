@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConnectFour.h"
+#include "Parallel.h"
+#include "Stopwatch.h"
+#include "TicTacToe.h"
+
+// Walks the full game tree to a fixed depth through the generic game
+// interface and counts, for every ply, the positions reached and the games
+// that have ended by then, split into first player wins, second player wins
+// and draws. The counts are checked against reference values computed with
+// the original array-based engines, so a change to move generation or to
+// win detection that alters the tree is caught, and nodes per second shows
+// whether it got faster.
+//
+// usage: perft <tictactoe|connect_four> [depth] [threads]
+//
+// The subtrees below the first plies are shared out between the threads.
+
+struct PerftCounts {
+  uint64_t nodes = 0;
+  uint64_t first_player_wins = 0;
+  uint64_t second_player_wins = 0;
+  uint64_t draws = 0;
+};
+
+// Expected counts at plies 0, 1, 2, ...; the outcome counts are the games
+// ended at or before the ply.
+const PerftCounts kTicTacToeReference[] = {
+  {1, 0, 0, 0},
+  {9, 0, 0, 0},
+  {72, 0, 0, 0},
+  {504, 0, 0, 0},
+  {3024, 0, 0, 0},
+  {15120, 1440, 0, 0},
+  {54720, 1440, 5328, 0},
+  {148176, 49392, 5328, 0},
+  {200448, 49392, 77904, 0},
+  {127872, 131184, 77904, 46080},
+};
+
+const PerftCounts kConnectFourReference[] = {
+  {1, 0, 0, 0},
+  {7, 0, 0, 0},
+  {49, 0, 0, 0},
+  {343, 0, 0, 0},
+  {2401, 0, 0, 0},
+  {16807, 0, 0, 0},
+  {117649, 0, 0, 0},
+  {823536, 13032, 0, 0},
+  {5673234, 13032, 44430, 0},
+  {39394572, 1099914, 44430, 0},
+  {268031646, 1099914, 4305488, 0},
+};
+
+// Adds the positions of the subtree of state, which is at ply, to
+// counts[ply..depth]. Outcomes are recorded at the ply the game ended.
+template <class Game>
+void Perft(const Game& state, int ply, int depth, PerftCounts* counts) {
+  counts[ply].nodes++;
+  if(state.GameOver()) {
+    if(state.Draw()) {
+      counts[ply].draws++;
+    } else if(state.FirstPlayersTurn()) {
+      counts[ply].second_player_wins++;
+    } else {
+      counts[ply].first_player_wins++;
+    }
+    return;
+  }
+  if(ply == depth) {
+    return;
+  }
+  for(auto const& action : state.GetAvailableActions()) {
+    Perft(state.ForwardModel(action), ply + 1, depth, counts);
+  }
+}
+
+// Positions at split_ply, and the counts of the plies above it, which are
+// walked on the calling thread.
+template <class Game>
+void Split(const Game& state, int ply, int split_ply, PerftCounts* counts,
+           std::vector<Game>& roots) {
+  if(ply == split_ply && !state.GameOver()) {
+    roots.push_back(state);
+    return;
+  }
+  counts[ply].nodes++;
+  if(state.GameOver()) {
+    if(state.Draw()) {
+      counts[ply].draws++;
+    } else if(state.FirstPlayersTurn()) {
+      counts[ply].second_player_wins++;
+    } else {
+      counts[ply].first_player_wins++;
+    }
+    return;
+  }
+  for(auto const& action : state.GetAvailableActions()) {
+    Split(state.ForwardModel(action), ply + 1, split_ply, counts, roots);
+  }
+}
+
+template <class Game>
+std::vector<PerftCounts> ParallelPerft(int depth, size_t num_threads) {
+  std::vector<PerftCounts> counts(depth + 1);
+
+  // Split deep enough to give every thread several subtrees to balance.
+  std::vector<Game> roots;
+  int split_ply = 0;
+  while(true) {
+    std::vector<PerftCounts> above(depth + 1);
+    roots.clear();
+    Split(Game(), 0, split_ply, above.data(), roots);
+    if(split_ply == depth || roots.size() >= 8 * num_threads) {
+      counts = above;
+      break;
+    }
+    split_ply++;
+  }
+
+  std::vector<std::vector<PerftCounts>> thread_counts(num_threads,
+                                                      std::vector<PerftCounts>(depth + 1));
+  std::atomic<size_t> next(0);
+  ParallelFor(num_threads, [&](size_t thread) {
+    for(size_t i = next++; i < roots.size(); i = next++) {
+      Perft(roots[i], split_ply, depth, thread_counts[thread].data());
+    }
+  });
+  for(auto const& per_thread : thread_counts) {
+    for(int ply = 0; ply <= depth; ply++) {
+      counts[ply].nodes += per_thread[ply].nodes;
+      counts[ply].first_player_wins += per_thread[ply].first_player_wins;
+      counts[ply].second_player_wins += per_thread[ply].second_player_wins;
+      counts[ply].draws += per_thread[ply].draws;
+    }
+  }
+  return counts;
+}
+
+template <class Game>
+bool Run(int depth, size_t num_threads, PerftCounts const* reference, size_t num_references) {
+  Stopwatch sw;
+  sw.Start();
+  std::vector<PerftCounts> counts = ParallelPerft<Game>(depth, num_threads);
+  sw.Stop();
+
+  bool ok = true;
+  uint64_t total_nodes = 0;
+  PerftCounts ended;
+  std::printf("%5s %14s %12s %12s %12s  %s\n", "depth", "nodes", "x_wins", "o_wins", "draws", "check");
+  for(int ply = 0; ply <= depth; ply++) {
+    total_nodes += counts[ply].nodes;
+    ended.first_player_wins += counts[ply].first_player_wins;
+    ended.second_player_wins += counts[ply].second_player_wins;
+    ended.draws += counts[ply].draws;
+
+    char const* check = "-";
+    if(size_t(ply) < num_references) {
+      PerftCounts const& expected = reference[ply];
+      bool match = expected.nodes == counts[ply].nodes &&
+                   expected.first_player_wins == ended.first_player_wins &&
+                   expected.second_player_wins == ended.second_player_wins &&
+                   expected.draws == ended.draws;
+      check = match ? "ok" : "MISMATCH";
+      ok = ok && match;
+    }
+    std::printf("%5d %14llu %12llu %12llu %12llu  %s\n", ply,
+                (unsigned long long)counts[ply].nodes,
+                (unsigned long long)ended.first_player_wins,
+                (unsigned long long)ended.second_player_wins,
+                (unsigned long long)ended.draws, check);
+  }
+  std::printf("%llu nodes in %.1f ms on %zu threads, %.4g nodes/s\n",
+              (unsigned long long)total_nodes, sw.ElapsedMillis(), num_threads,
+              total_nodes / sw.ElapsedMillis() * 1000);
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  if(argc < 2) {
+    std::fprintf(stderr, "usage: %s <tictactoe|connect_four> [depth] [threads]\n", argv[0]);
+    return 1;
+  }
+  std::string game = argv[1];
+  size_t num_threads = argc > 3 ? std::max(1, std::atoi(argv[3]))
+                                : std::max(1u, std::thread::hardware_concurrency());
+  bool ok;
+  if(game == "tictactoe") {
+    int depth = argc > 2 ? std::atoi(argv[2]) : 9;
+    ok = Run<TicTacToe>(std::min(std::max(depth, 0), 9), num_threads, kTicTacToeReference,
+                        std::size(kTicTacToeReference));
+  } else if(game == "connect_four") {
+    int depth = argc > 2 ? std::atoi(argv[2]) : 9;
+    int max_depth = CONNECT_FOUR_NUM_ROWS * CONNECT_FOUR_NUM_COLS;
+    // The reference counts are for the standard 6x7 board.
+    bool standard = CONNECT_FOUR_NUM_ROWS == 6 && CONNECT_FOUR_NUM_COLS == 7;
+    ok = Run<ConnectFour>(std::min(std::max(depth, 0), max_depth), num_threads, kConnectFourReference,
+                          standard ? std::size(kConnectFourReference) : 0);
+  } else {
+    std::fprintf(stderr, "unknown game %s\n", argv[1]);
+    return 1;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "AllocationCounter.h"
+#include "ConnectFour.h"
+#include "Random.h"
+#include "TestGame.h"
+#include "TicTacToe.h"
+#include "utils.h"
+
+// Plays random games through the generic game interface and counts the
+// heap allocations they make. Action generation returns fixed-capacity
+// lists on the stack, so a rollout should never reach the allocator; the
+// exit status is 1 if one did.
+//
+// usage: rollout_allocations [rollouts]
+
+// Returns the allocations made by the rollouts; the first game is set up
+// before counting starts.
+template <class Game>
+uint64_t CountRolloutAllocations(char const* name, int rollouts, Xoshiro256& rng) {
+  Game start;
+  uint64_t moves = 0;
+  uint64_t allocations = NumAllocations();
+  for(int i = 0; i < rollouts; i++) {
+    Game game = start;
+    while(!game.GameOver()) {
+      auto actions = game.GetAvailableActions();
+      game = game.ForwardModel(*select_randomly(actions.begin(), actions.end(), rng));
+      moves++;
+    }
+  }
+  allocations = NumAllocations() - allocations;
+  std::printf("%-14s %8d rollouts %10llu moves %8llu allocations\n", name, rollouts,
+              (unsigned long long)moves, (unsigned long long)allocations);
+  return allocations;
+}
+
+int main(int argc, char* argv[]) {
+  int rollouts = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10000;
+  Xoshiro256 rng(1);
+  uint64_t allocations = 0;
+  allocations += CountRolloutAllocations<TicTacToe>("tictactoe", rollouts, rng);
+  allocations += CountRolloutAllocations<ConnectFour>("connect_four", rollouts, rng);
+  allocations += CountRolloutAllocations<TestGame>("test_game", rollouts, rng);
+  return allocations == 0 ? 0 : 1;
+}
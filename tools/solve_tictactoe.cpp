@@ -0,0 +1,24 @@
+#include <cstring>
+#include <iostream>
+
+#include "MinimaxAgent.h"
+#include "TicTacToe.h"
+
+// Solves TicTacToe from the empty board and writes the result as a
+// SolvedDatabase for MinimaxAgent::LoadSolvedDatabase.
+//
+// usage: solve_tictactoe <output_path> [--symmetry]
+int main(int argc, char* argv[]) {
+  if(argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <output_path> [--symmetry]" << std::endl;
+    return 1;
+  }
+  MinimaxAgent<TicTacToe> agent;
+  agent.SetUseSymmetry(argc > 2 && std::strcmp(argv[2], "--symmetry") == 0);
+  agent.Solve(TicTacToe());
+  if(!agent.SaveSolvedDatabase(argv[1])) {
+    std::cerr << "could not write " << argv[1] << std::endl;
+    return 1;
+  }
+  std::cout << "wrote " << agent.minimax_tree.size() << " positions to " << argv[1] << std::endl;
+}